@@ -1,34 +1,24 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "cinder/Filesystem.h"
+#include "cinder/Quaternion.h"
 #include "cinder/Vector.h"
 
 #include "AssimpLoader.h"
+#include "RetargetMap.h"
+
+struct Pose;
 
 typedef std::shared_ptr< class Avatar > AvatarRef;
 
 class Avatar
 {
  public:
-	static AvatarRef create( const ci::fs::path &modelPath )
-	{ return AvatarRef( new Avatar( modelPath ) ); }
-
-	void update();
-	void draw();
-
-	void setPosition( size_t frameId, size_t jointId, const ci::Vec3f &position );
-	void setOrientation( size_t frameId, size_t jointId, const ci::Vec3f &eulerDegrees );
-
- protected:
-	Avatar( const ci::fs::path &modelPath );
-
-	void collectJoints();
-
-	mndl::assimp::AssimpLoaderRef mAssimpLoader;
-
 	enum Joints
 	{
 		HIP = 0,
@@ -99,7 +89,88 @@ class Avatar
 		TOTAL_JOINTS
 	};
 
+	//! Drives the nodes of \a retargetMap, or the nodes with the joint names if no map is given.
+	static AvatarRef create( const ci::fs::path &modelPath,
+							 const RetargetMapRef &retargetMap = RetargetMapRef() )
+	{ return AvatarRef( new Avatar( modelPath, retargetMap ) ); }
+
+	//! True if the materials of the model reference textures. The model loader creates them
+	//! during the import, so only models without textures can be created off the gl thread.
+	static bool hasTextures( const ci::fs::path &modelPath );
+
+	void update();
+	void draw();
+
+	void enableSkinning( bool enable = true );
+	void disableSkinning() { enableSkinning( false ); }
+
+	void setPosition( size_t frameId, size_t jointId, const ci::Vec3f &position );
+	void setOrientation( size_t frameId, size_t jointId, const ci::Vec3f &eulerDegrees );
+
+	//! Sets the joints present in \a pose at once, not thread-safe.
+	void setPose( const Pose &pose );
+
+	//! Converts BVH euler angles in ZXY order to a quaternion.
+	static ci::Quatf eulerToQuat( const ci::Vec3f &eulerDegrees );
+
+	//! Returns the first node driven by \a jointId, null if the joint is not mapped.
+	const mndl::assimp::AssimpNodeRef & getJointNode( size_t jointId ) const { return mJoints[ jointId ]; }
+
+	//! Fills the TOTAL_JOINTS long arrays with the world transforms of the joints,
+	//! unmapped joints are left alone. Call after update().
+	void getJointTransforms( ci::Vec3f *positions, ci::Quatf *orientations ) const;
+	//! Sets the world orientation of the node of \a jointId. Set the joints of a chain from the parent to the child.
+	void setJointWorldOrientation( size_t jointId, const ci::Quatf &orientation );
+	//! Moves the hip by \a offset in world space on top of the hip position of the poses.
+	void setRootOffset( const ci::Vec3f &offset );
+	const ci::Vec3f & getRootOffset() const { return mRootOffset; }
+
+	//! The bind pose meshes of the model for skinning from joint transforms on the gpu.
+	struct Skin
+	{
+		struct Vertex
+		{
+			ci::Vec3f mPosition;
+			float mBones[ 4 ];
+			float mWeights[ 4 ];
+		};
+		std::vector< Vertex > mVertices;
+		std::vector< uint32_t > mIndices;
+		//! Four texels per bone, the rows of the matrix from the bind pose to the world space of its joint
+		//! without scale, then the joint id in x, -1 for bones that are not below a joint.
+		std::vector< ci::Vec4f > mBones;
+	};
+	//! Imports the skin of \a modelPath, the model of this avatar, on any thread. A bone follows the closest
+	//! joint at or above its node. Returns false if the import failed.
+	bool getSkin( const ci::fs::path &modelPath, Skin *skin ) const;
+
+	static const std::string & getJointName( size_t jointId ) { return sJointNames[ jointId ]; }
+	//! Returns TOTAL_JOINTS for unknown names.
+	static size_t findJointId( const std::string &name );
+
+ protected:
+	Avatar( const ci::fs::path &modelPath, const RetargetMapRef &retargetMap );
+
+	void collectJoints( const RetargetMapRef &retargetMap );
+	void applyRootOffset();
+
+	mndl::assimp::AssimpLoaderRef mAssimpLoader;
+
+	//! Retarget entry with its node and its offsets resolved when the avatar is created.
+	struct JointTarget
+	{
+		RetargetMap::Entry mEntry;
+		mndl::assimp::AssimpNodeRef mNode;
+	};
+	//! Sorted by source joint, the targets of joint i are [ mTargetBegin[ i ], mTargetBegin[ i + 1 ] ).
+	std::vector< JointTarget > mTargets;
+	size_t mTargetBegin[ Joints::TOTAL_JOINTS + 1 ];
+
 	mndl::assimp::AssimpNodeRef mJoints[ Joints::TOTAL_JOINTS ];
 
+	// the hip position set by the poses and the offset added to it
+	ci::Vec3f mRootPosition;
+	ci::Vec3f mRootOffset;
+
 	static std::string sJointNames[ Joints::TOTAL_JOINTS ];
 };
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "OscClient.h"
+#include "OscServer.h"
+
+typedef std::shared_ptr< class ClusterSync > ClusterSyncRef;
+
+/*
+ Keeps several renderer processes on the same pose frame. The master
+ announces the latest frame id of the pose stream with a presentation deadline:
+
+	/sync frameId deadline masterTime    (idd, times in master clock seconds)
+
+ The master and the followers queue the announced frames and display each
+ one, from the same pose stream, in the frame during which its deadline
+ falls. The presentation delay adds latency but is pipelined, the swap is
+ held at most a frame interval. Followers report how late they were:
+
+	/sync/lag followerId frameId lagMs frameLag    (iifi)
+
+ The follower estimates the master clock offset from the smallest observed
+ difference between the receive time and masterTime.
+*/
+class ClusterSync
+{
+ public:
+	enum Mode
+	{
+		MODE_OFF = 0,
+		MODE_MASTER,
+		MODE_FOLLOWER
+	};
+
+	static ClusterSyncRef create( mndl::osc::Server *listener )
+	{ return ClusterSyncRef( new ClusterSync( listener ) ); }
+
+	~ClusterSync();
+
+	void setMode( Mode mode );
+	Mode getMode() const { return mMode; }
+
+	//! Master: comma separated unicast addresses of the followers. Follower: address of the master.
+	void setPeer( const std::string &hosts, int port );
+	void setFollowerId( int followerId ) { mFollowerId = followerId; }
+	//! Time between the master starting a frame and its presentation.
+	void setPresentationDelay( float ms ) { mPresentationDelay = ms * 0.001; }
+
+	//! Master: announces \a latestFrameId, -1 or an id announced already are skipped. Returns the
+	//! announced frame to display, the latest one due before the next frame, -1 while none was due
+	//! yet. Without a mode returns \a latestFrameId. Call at the start of the frame.
+	int32_t beginFrame( int32_t latestFrameId );
+	//! Blocks until the presentation deadline of a frame picked by beginFrame(), at most a frame
+	//! interval, call right before the swap. Followers report their lag for \a displayedFrameId.
+	void waitForDeadline( int32_t displayedFrameId );
+
+	//! Master: the largest lag in ms reported by the followers recently.
+	float getMaxFollowerLag();
+	//! Follower: how late the last swap was compared to the deadline in ms.
+	float getLag() const { return mLag; }
+
+ protected:
+	ClusterSync( mndl::osc::Server *listener );
+
+	//! Call with the mutex locked.
+	void addAnnouncement( int32_t frameId, double deadline );
+
+	bool syncReceived( const mndl::osc::Message &message );
+	bool lagReceived( const mndl::osc::Message &message );
+
+	mndl::osc::Server *mListener;
+	std::vector< uint32_t > mHandlerIds;
+	std::vector< std::shared_ptr< mndl::osc::Client > > mClients;
+
+	std::atomic< Mode > mMode { MODE_OFF };
+	int mFollowerId = 0;
+	double mPresentationDelay = 0.05;
+
+	// deadline of the displayed frame in local clock seconds, pending until the swap after it was picked
+	double mDeadline = 0.0;
+	bool mDeadlinePending = false;
+	int32_t mFrameId = -1;
+	int32_t mLastAnnouncedFrameId = -1;
+	float mLag = 0.0f;
+	// smoothed time between the frames, frames are picked when they are due before the next one
+	double mLastFrameStart = -1.0;
+	double mFrameInterval = 1.0 / 60.0;
+
+	// written on the osc thread
+	std::mutex mMutex;
+	struct Announcement
+	{
+		int32_t mFrameId;
+		// master clock seconds
+		double mDeadline;
+	};
+	std::deque< Announcement > mAnnouncements;
+	double mClockOffset = 0.0;
+	bool mClockOffsetValid = false;
+
+	struct FollowerLag
+	{
+		float mLag;
+		double mTime;
+	};
+	std::map< int, FollowerLag > mFollowerLags;
+};
@@ -2,10 +2,13 @@
 
 #include <functional>
 #include <memory>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "cinder/Color.h"
 #include "cinder/Quaternion.h"
+#include "cinder/Vector.h"
 #include "cinder/Xml.h"
 
 namespace mndl
@@ -13,137 +16,112 @@ namespace mndl
 
 typedef std::shared_ptr< class Config > ConfigRef;
 
+//! Registry of variables saved to an xml file. The name of a variable is its
+//! path in the file, "Camera/Fov" is stored as <Camera><Fov value="45"/></Camera>.
+//! Variables are kept in one array of typed descriptors indexed by name, so
+//! reading and writing the file are single passes.
 class Config
 {
  public:
 	static ConfigRef create() { return ConfigRef( new Config() ); }
 
-	template< typename T, typename TVAL >
-	void addVar( const std::string &name, T *var, const TVAL &defVal )
+	enum Type
 	{
-		*var = (T)defVal;
-		mConfigReadCallbacks.push_back( [ = ] ( ci::XmlTree &xml )
-				{ Config::readVar( var, defVal, name, xml ); } );
-		mConfigWriteCallbacks.push_back( [ = ] ( ci::XmlTree &xml )
-				{ Config::writeVar( var, name, xml ); } );
-	}
-
-	void read( const ci::DataSourceRef &source );
-	void write( const ci::DataTargetRef &target );
-
- protected:
-	Config() {}
-
+		TYPE_BOOL = 0,
+		TYPE_INT,
+		TYPE_FLOAT,
+		TYPE_DOUBLE,
+		TYPE_STRING,
+		TYPE_VEC2I,
+		TYPE_VEC2F,
+		TYPE_VEC3F,
+		TYPE_QUATF,
+		TYPE_COLOR,
+		TYPE_COLORA
+	};
+
+	//! Registers \a var and sets it to \a defVal. Returns false and leaves
+	//! \a var alone if \a name is registered already.
 	template< typename T, typename TVAL >
-	void readVar( T *var, TVAL defVal, const std::string &name, ci::XmlTree &xml )
+	bool addVar( const std::string &name, T *var, const TVAL &defVal )
 	{
-		*var = xml.hasChild( name ) ?
-			   xml.getChild( name ).getAttributeValue( "value", defVal ) :
-			   (T)defVal;
+		T def = (T)defVal;
+		return addVar( name, TypeOf< T >::value, var, &def );
 	}
 
-	template< typename T >
-	void writeVar( T *var, const std::string &name, ci::XmlTree &xml )
-	{
-		addChild( name, xml );
-		ci::XmlTree &node = xml.getChild( name );
-		node.setAttribute( "value", *var );
-	}
+	//! Calls \a changedFn whenever the value of \a name changes, by read() or
+	//! in the program as detected by update(). It is called once right away.
+	void setChangedFn( const std::string &name, const std::function< void () > &changedFn );
 
-	void readVar( ci::ColorA *var, const ci::ColorA &defVal,
-				  const std::string &name, ci::XmlTree &xml );
-	void writeVar( ci::ColorA *var, const std::string &name, ci::XmlTree &xml );
+	//! Detects the changes of the variables with a change function since the
+	//! last call, marks them dirty and calls the functions. Call once per frame.
+	void update();
 
-	void readVar( ci::Color *var, const ci::Color &defVal,
-				  const std::string &name, ci::XmlTree &xml );
-	void writeVar( ci::Color *var, const std::string &name, ci::XmlTree &xml );
+	//! True if \a name changed since the last clearDirty(), variables without a
+	//! change function are compared when asked.
+	bool isDirty( const std::string &name ) const;
+	void clearDirty( const std::string &name );
 
-	template< typename T >
-	void readVar( ci::Vec2< T > *var, const ci::Vec2< T > &defVal,
-					const std::string &name, ci::XmlTree &xml )
-	{
-		if ( xml.hasChild( name ) )
-		{
-			var->x = xml.getChild( name ).getAttributeValue( "x", defVal.x );
-			var->y = xml.getChild( name ).getAttributeValue( "y", defVal.y );
-		}
-		else
-		{
-			*var = defVal;
-		}
-	}
+	void read( const ci::DataSourceRef &source );
+	void write( const ci::DataTargetRef &target );
 
-	template< typename T >
-	void writeVar( ci::Vec2< T > *var, const std::string &name, ci::XmlTree &xml )
-	{
-		addChild( name, xml );
-		ci::XmlTree &node = xml.getChild( name );
-		node.setAttribute( "x", var->x );
-		node.setAttribute( "y", var->y );
-	}
+ protected:
+	Config() {}
 
-	template< typename T >
-	void readVar( ci::Vec3< T > *var, const ci::Vec3< T > &defVal,
-					const std::string &name, ci::XmlTree &xml )
-	{
-		if ( xml.hasChild( name ) )
-		{
-			var->x = xml.getChild( name ).getAttributeValue( "x", defVal.x );
-			var->y = xml.getChild( name ).getAttributeValue( "y", defVal.y );
-			var->z = xml.getChild( name ).getAttributeValue( "z", defVal.z );
-		}
-		else
-		{
-			*var = defVal;
-		}
-	}
+	template< typename T > struct TypeOf;
 
-	template< typename T >
-	void writeVar( ci::Vec3< T > *var, const std::string &name, ci::XmlTree &xml )
+	//! Value of any supported type, numbers are stored as doubles.
+	struct Value
 	{
-		addChild( name, xml );
-		ci::XmlTree &node = xml.getChild( name );
-		node.setAttribute( "x", var->x );
-		node.setAttribute( "y", var->y );
-		node.setAttribute( "z", var->z );
-	}
+		double mNumbers[ 4 ];
+		std::string mString;
 
-	template< typename T >
-	void readVar( ci::Quaternion< T > *var, const ci::Quaternion< T > &defVal,
-					const std::string &name, ci::XmlTree &xml )
-	{
-		if ( xml.hasChild( name ) )
-		{
-			var->v.x = xml.getChild( name ).getAttributeValue( "x", defVal.v.x );
-			var->v.y = xml.getChild( name ).getAttributeValue( "y", defVal.v.y );
-			var->v.z = xml.getChild( name ).getAttributeValue( "z", defVal.v.z );
-			var->w = xml.getChild( name ).getAttributeValue( "w", defVal.w );
-		}
-		else
-		{
-			*var = defVal;
-		}
-	}
+		bool operator==( const Value &rhs ) const;
+		bool operator!=( const Value &rhs ) const { return ! ( *this == rhs ); }
+	};
 
-	template< typename T >
-	void writeVar( ci::Quaternion< T > *var, const std::string &name, ci::XmlTree &xml )
+	struct Var
 	{
-		addChild( name, xml );
-		ci::XmlTree &node = xml.getChild( name );
-		node.setAttribute( "x", var->v.x );
-		node.setAttribute( "y", var->v.y );
-		node.setAttribute( "z", var->v.z );
-		node.setAttribute( "w", var->w );
-	}
-
-	std::string colorToHex( const ci::ColorA &color );
-	ci::ColorA hexToColor( const std::string &hexStr );
-
-	void addChild( const std::string &name, ci::XmlTree &xml );
-
-	std::vector< std::function< void ( ci::XmlTree & ) > > mConfigReadCallbacks;
-	std::vector< std::function< void ( ci::XmlTree & ) > > mConfigWriteCallbacks;
+		std::string mName;
+		Type mType;
+		void *mPtr;
+		Value mDefault;
+		// the value at the last change check
+		Value mLast;
+		bool mDirty;
+		std::function< void () > mChangedFn;
+	};
+
+	bool addVar( const std::string &name, Type type, void *var, const void *defVal );
+	Var * findVar( const std::string &name );
+	const Var * findVar( const std::string &name ) const;
+	void checkChanged( Var &var );
+
+	static void load( Type type, const void *ptr, Value *value );
+	static void store( Type type, const Value &value, void *ptr );
+	static void readValue( Type type, const ci::XmlTree &node, Value *value );
+	static void writeValue( Type type, const Value &value, ci::XmlTree &node );
+	void readNode( const ci::XmlTree &node, const std::string &path, std::vector< bool > *found );
+
+	static std::string colorToHex( const ci::ColorA &color );
+	static ci::ColorA hexToColor( const std::string &hexStr );
+
+	std::vector< Var > mVars;
+	std::unordered_map< std::string, size_t > mVarIndices;
+	// the vars with a change function, the only ones update() checks
+	std::vector< size_t > mWatchedVars;
 };
 
-};
+template<> struct Config::TypeOf< bool > { static const Type value = TYPE_BOOL; };
+template<> struct Config::TypeOf< int > { static const Type value = TYPE_INT; };
+template<> struct Config::TypeOf< float > { static const Type value = TYPE_FLOAT; };
+template<> struct Config::TypeOf< double > { static const Type value = TYPE_DOUBLE; };
+template<> struct Config::TypeOf< std::string > { static const Type value = TYPE_STRING; };
+template<> struct Config::TypeOf< ci::Vec2i > { static const Type value = TYPE_VEC2I; };
+template<> struct Config::TypeOf< ci::Vec2f > { static const Type value = TYPE_VEC2F; };
+template<> struct Config::TypeOf< ci::Vec3f > { static const Type value = TYPE_VEC3F; };
+template<> struct Config::TypeOf< ci::Quatf > { static const Type value = TYPE_QUATF; };
+template<> struct Config::TypeOf< ci::Color > { static const Type value = TYPE_COLOR; };
+template<> struct Config::TypeOf< ci::ColorA > { static const Type value = TYPE_COLORA; };
 
+};
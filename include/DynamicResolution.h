@@ -0,0 +1,68 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+
+#include "cinder/Area.h"
+#include "cinder/Vector.h"
+#include "cinder/gl/Fbo.h"
+#include "cinder/gl/gl.h"
+
+typedef std::shared_ptr< class DynamicResolution > DynamicResolutionRef;
+
+//! Renders the scene to an offscreen framebuffer at a fraction of the window
+//! resolution and upscales it to the window. The fraction follows the gpu
+//! time of the scene measured with timer queries, so the frame time stays
+//! near the target under changing load instead of missing frames.
+class DynamicResolution
+{
+ public:
+	static DynamicResolutionRef create() { return DynamicResolutionRef( new DynamicResolution() ); }
+
+	~DynamicResolution();
+
+	//! Gpu time of the scene to hold in ms.
+	void setTargetTime( float ms ) { mTargetTime = std::max( ms, 0.1f ); }
+	//! Smallest fraction of the window size per axis, 1 keeps the native resolution.
+	void setMinScale( float scale ) { mMinScale = std::min( std::max( scale, 0.1f ), 1.0f ); }
+	//! Disabled the scale is fixed at 1, the gpu time is still measured.
+	void enable( bool enabled = true ) { mEnabled = enabled; }
+	void disable() { enable( false ); }
+
+	//! Binds the scene framebuffer with the viewport of the current scale. \a windowSize
+	//! is the size of the final image, the framebuffer is reallocated when it changes.
+	void bind( const ci::Vec2i &windowSize );
+	//! Unbinds the scene framebuffer and restores the window viewport.
+	void unbind();
+	//! Draws the scene upscaled to \a bounds with bilinear filtering.
+	void draw( const ci::Area &bounds );
+
+	float getScale() const { return mScale; }
+	//! Smoothed gpu time of the scene in ms.
+	float getGpuTime() const { return mGpuTime; }
+
+ protected:
+	DynamicResolution() {}
+
+	ci::Vec2i getScaledSize() const;
+	void readQueries();
+	void updateScale( float gpuTime );
+
+	float mTargetTime = 12.0f;
+	float mMinScale = 0.5f;
+	bool mEnabled = true;
+
+	float mScale = 1.0f;
+	float mGpuTime = 0.0f;
+
+	ci::gl::Fbo mFbo;
+	ci::Vec2i mSize;
+
+	// results arrive a few frames later, the queries are reused round robin
+	static const size_t NUM_QUERIES = 4;
+	GLuint mQueries[ NUM_QUERIES ];
+	bool mQueryPending[ NUM_QUERIES ];
+	size_t mQueryIndex = 0;
+	bool mQueriesCreated = false;
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "Avatar.h"
+
+typedef std::shared_ptr< class FootGrounding > FootGroundingRef;
+
+//! Keeps the feet of the avatars on a horizontal ground plane with analytic
+//! two bone ik of the thigh, shin and foot chains, and optionally pushes the
+//! hands out of the ground with the shoulder, forearm and hand chains. A foot
+//! is in contact with the ground between two height thresholds, feet in
+//! contact are pinned to the ground and the hip is lowered when they cannot
+//! reach it. The chains of all avatars are solved in one pass over structure
+//! of arrays, so the lane loops vectorize.
+class FootGrounding
+{
+ public:
+	static FootGroundingRef create() { return FootGroundingRef( new FootGrounding() ); }
+
+	void setGroundHeight( float height ) { mGroundHeight = height; }
+	//! Height of the ankles and the wrists above the ground when the feet and the hands rest on it.
+	void setFootHeight( float height ) { mFootHeight = height; }
+	void setHandHeight( float height ) { mHandHeight = height; }
+	//! Contact begins below the rest height plus \a enter and ends above the rest height plus \a exit.
+	void setContactThresholds( float enter, float exit );
+	//! Time constant of the hip height correction in seconds.
+	void setHipSmoothing( float seconds ) { mHipSmoothing = seconds; }
+	void enableArms( bool enable = true ) { mArmsEnabled = enable; }
+
+	//! Grounds \a avatars after their poses are set and before Avatar::update() skins them,
+	//! \a time is the frame time in seconds. The contact state is kept per index of \a avatars.
+	void apply( const std::vector< AvatarRef > &avatars, double time );
+	void apply( const AvatarRef &avatar, double time );
+
+	//! apply() is gather() of every avatar, solve() and scatter() of every avatar,
+	//! they are separate to time the solver on its own.
+	void resize( size_t numAvatars );
+	void gather( size_t index, const AvatarRef &avatar );
+	void solve( double time );
+	void scatter( size_t index, const AvatarRef &avatar ) const;
+
+	//! Drops the contact states and the hip corrections.
+	void reset();
+
+	bool isInContact( size_t index, size_t chain ) const { return mLanes[ CONTACT ][ index * NUM_CHAINS + chain ] > 0.5f; }
+
+	enum Chains
+	{
+		LEFT_LEG = 0,
+		RIGHT_LEG,
+		LEFT_ARM,
+		RIGHT_ARM,
+		NUM_CHAINS
+	};
+
+ protected:
+	FootGrounding() {}
+
+	void updateContacts();
+	void updateHipOffsets( float alpha );
+	void solveChains();
+
+	// a lane per chain of an avatar
+	enum Channel
+	{
+		ROOT_X = 0, ROOT_Y, ROOT_Z,
+		MID_X, MID_Y, MID_Z,
+		END_X, END_Y, END_Z,
+		// world orientations of the root and the middle joint, replaced by the solution
+		ROOT_QW, ROOT_QX, ROOT_QY, ROOT_QZ,
+		MID_QW, MID_QX, MID_QY, MID_QZ,
+		// world orientation of the end joint, which is kept
+		END_QW, END_QX, END_QY, END_QZ,
+		// 1 if the joints of the chain are mapped and the chain is enabled
+		ENABLED,
+		// 1 for the legs, which lower the hip
+		SUPPORT,
+		REST_HEIGHT,
+		CONTACT,
+		// the hip offset required by the chain, then the offset applied to its avatar
+		HIP_OFFSET,
+		NUM_CHANNELS
+	};
+
+	size_t mNumAvatars = 0;
+	std::vector< float > mLanes[ NUM_CHANNELS ];
+	std::vector< float > mHipOffsets;
+
+	float mGroundHeight = 0.0f;
+	float mFootHeight = 8.0f;
+	float mHandHeight = 4.0f;
+	float mContactEnter = 2.0f;
+	float mContactExit = 6.0f;
+	float mHipSmoothing = 0.1f;
+	bool mArmsEnabled = false;
+
+	double mLastTime = -1.0;
+};
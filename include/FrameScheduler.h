@@ -0,0 +1,59 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+#include "PoseBuffer.h"
+
+typedef std::shared_ptr< class FrameScheduler > FrameSchedulerRef;
+
+//! Paces the render loop instead of redrawing as fast as possible. The loop
+//! sleeps until a new pose arrives or the idle frame is due, then until the
+//! latest time that still makes the next vertical blank with the predicted
+//! render cost, so the newest pose is rendered with the least latency.
+class FrameScheduler
+{
+ public:
+	static FrameSchedulerRef create() { return FrameSchedulerRef( new FrameScheduler() ); }
+
+	void setRefreshRate( float hz ) { mRefreshPeriod = 1.0 / std::max( hz, 1.0f ); }
+	//! Frames per second without new poses, keeps the ui responsive.
+	void setIdleRate( float hz ) { mIdlePeriod = 1.0 / std::max( hz, 0.1f ); }
+	//! Safety margin in ms added to the predicted render cost.
+	void setMargin( float ms ) { mMargin = ms * 0.001; }
+	//! Without vertical sync frames start right when a pose arrives.
+	void setVerticalSync( bool enabled ) { mVerticalSync = enabled; }
+
+	//! Blocks until the next frame should start, call at the beginning of update(),
+	//! right after the previous frame has been swapped.
+	void waitForFrame( const PoseBufferRef &poseBuffer );
+	//! Call when the frame has been submitted at the end of draw(), \a gpuTime is the measured
+	//! gpu time of the frame in ms. Frames that did not start with waitForFrame() are not counted.
+	void endFrame( float gpuTime = 0.0f );
+
+	//! Predicted cost of update and draw in ms, the cpu time or the gpu time, whichever is longer.
+	float getPredictedCost() const { return static_cast< float >( mPredictedCost * 1000.0 ); }
+
+ protected:
+	FrameScheduler();
+
+	typedef std::chrono::steady_clock Clock;
+	typedef std::chrono::duration< double > Seconds;
+
+	double mRefreshPeriod = 1.0 / 60.0;
+	double mIdlePeriod = 1.0 / 30.0;
+	double mMargin = 0.002;
+	bool mVerticalSync = true;
+
+	Clock::time_point mLastSwap;
+	Clock::time_point mLastFrameStart;
+	Clock::time_point mFrameStart;
+	bool mFrameStarted = false;
+
+	// the most expensive of the recent frames is the prediction
+	static const size_t NUM_COSTS = 32;
+	double mCosts[ NUM_COSTS ];
+	size_t mCostIndex = 0;
+	double mPredictedCost = 0.0;
+};
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+typedef std::shared_ptr< class LatencyStats > LatencyStatsRef;
+
+//! Tracks the latency of pose frames from the sender timestamp through
+//! receive, apply, update, draw submit and buffer swap.
+class LatencyStats
+{
+ public:
+	static LatencyStatsRef create() { return LatencyStatsRef( new LatencyStats() ); }
+
+	enum Stage
+	{
+		SEND_TO_RECEIVE = 0,
+		RECEIVE_TO_APPLY,
+		APPLY_TO_UPDATE,
+		UPDATE_TO_DRAW,
+		DRAW_TO_SWAP,
+		TOTAL,
+		NUM_STAGES
+	};
+
+	class Histogram
+	{
+	 public:
+		Histogram();
+
+		void add( double ms );
+		void reset();
+
+		size_t getCount() const { return mCount; }
+		double getMean() const { return mCount ? mSum / mCount : 0.0; }
+		double getMax() const { return mMax; }
+		double getPercentile( double p ) const;
+
+		static const double BIN_WIDTH_MS;
+		static const size_t NUM_BINS = 1000;
+
+	 protected:
+		std::vector< uint32_t > mBins;
+		uint32_t mOverflow;
+		size_t mCount;
+		double mSum;
+		double mMax;
+	};
+
+	//! Wall clock time in seconds since the epoch, the sender timestamps are expected in the same clock.
+	static double now();
+
+	//! Thread-safe, \a senderTime is 0 if the message had no timestamp.
+	void markReceived( int32_t frameId, double senderTime = 0.0 );
+	//! Thread-safe, called when the pose of \a frameId has been set on the avatar.
+	void markApplied( int32_t frameId );
+	void markUpdated();
+	void markDrawn();
+	//! Called at the start of the next frame, after the buffers of the previous one were swapped.
+	void markSwapped();
+
+	const Histogram & getHistogram( Stage stage ) const { return mHistograms[ stage ]; }
+	uint32_t getSupersededFrames() const { return mSupersededFrames; }
+	void reset();
+
+	static const char * getStageName( Stage stage );
+
+	void writeCsvHeader( std::ostream &os ) const;
+	void writeCsvRow( std::ostream &os ) const;
+
+ protected:
+	LatencyStats();
+
+	struct FrameTiming
+	{
+		int32_t mFrameId = -1;
+		double mSent = 0.0;
+		double mReceived = 0.0;
+		double mApplied = 0.0;
+		double mUpdated = 0.0;
+		double mDrawn = 0.0;
+	};
+
+	static const size_t RECEIVED_HISTORY = 64;
+	FrameTiming mReceived[ RECEIVED_HISTORY ];
+	int32_t mLatestApplied = -1;
+	std::mutex mReceivedMutex;
+
+	FrameTiming mCurrent;
+	bool mCurrentPending = false;
+	int32_t mLastDisplayed = -1;
+
+	Histogram mHistograms[ NUM_STAGES ];
+	uint32_t mSupersededFrames = 0;
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "cinder/Color.h"
+#include "cinder/Quaternion.h"
+#include "cinder/Vector.h"
+#include "cinder/gl/GlslProg.h"
+#include "cinder/gl/gl.h"
+
+#include "Avatar.h"
+
+typedef std::shared_ptr< class MotionTrails > MotionTrailsRef;
+
+//! Keeps the world transforms of the avatar joints of the last frames in a
+//! ring buffer on the gpu. Each frame is written once with a single buffer
+//! update, the trails and the ghosts are drawn from the history with one
+//! instanced draw call each, however many frames they span. The ghosts are
+//! the bind pose skin of the avatar, skinned in the vertex shader with the
+//! joints of their frames.
+class MotionTrails
+{
+ public:
+	//! Keeps \a numFrames frames, needs the gl context.
+	static MotionTrailsRef create( size_t numFrames = 256 )
+	{ return MotionTrailsRef( new MotionTrails( numFrames ) ); }
+
+	~MotionTrails();
+
+	//! Writes the current joint transforms of \a avatar as the latest frame. Call once per frame after Avatar::update().
+	void addFrame( const AvatarRef &avatar );
+	//! Drops the history, the trails start again from the next frame. Call on discontinuities of the poses.
+	void clear() { mNumValidFrames = 0; }
+
+	//! Uploads the bind pose skin of the avatar for the ghosts, at most \a maxElements vertices and indices per call.
+	//! Returns false until the skin is complete, the ghosts are drawn from then on.
+	bool uploadSkin( const Avatar::Skin &skin, size_t maxElements );
+
+	//! Draws ribbons behind \a joints over the last \a length frames. The ribbons are \a width wide
+	//! along the x axis of the joints and fade out with age, a width of 0 gives lines.
+	void drawTrails( const std::vector< size_t > &joints, size_t length, float width, const ci::ColorA &color );
+	//! Draws \a count skinned ghosts, \a spacing frames apart, fading out with age.
+	void drawGhosts( size_t count, size_t spacing, const ci::ColorA &color );
+
+	size_t getNumFrames() const { return mNumFrames; }
+
+ protected:
+	MotionTrails( size_t numFrames );
+
+	void setupShaders();
+	void beginDraw( ci::gl::GlslProg &shader, const ci::ColorA &color );
+	void endDraw();
+
+	size_t mNumFrames;
+	// slot of the latest frame
+	size_t mHead = 0;
+	size_t mNumValidFrames = 0;
+
+	// a frame is a position and an orientation texel per joint
+	GLuint mBuffer = 0;
+	GLuint mTexture = 0;
+	std::vector< ci::Vec4f > mFrame;
+
+	ci::Vec3f mPositions[ Avatar::TOTAL_JOINTS ];
+	ci::Quatf mOrientations[ Avatar::TOTAL_JOINTS ];
+
+	// the skin vertices and indices, and the bind matrices of the bones as a buffer texture
+	GLuint mSkinBuffer = 0;
+	GLuint mSkinIndexBuffer = 0;
+	GLuint mBoneBuffer = 0;
+	GLuint mBoneTexture = 0;
+	// vertices then indices uploaded so far, the indices are drawn when all of them are
+	size_t mSkinUploaded = 0;
+	size_t mNumSkinIndices = 0;
+
+	ci::gl::GlslProg mTrailShader;
+	ci::gl::GlslProg mGhostShader;
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "cinder/Function.h"
+#include "cinder/Vector.h"
+#include "cinder/app/App.h"
+#include "cinder/gl/Fbo.h"
+#include "cinder/gl/GlslProg.h"
+#include "cinder/params/Params.h"
+
+typedef std::shared_ptr< class ParamsOverlay > ParamsOverlayRef;
+
+//! Draws the params through a cached texture. The bars are rendered to the
+//! texture only after input, a layout or visibility change, or when the
+//! refresh interval of the read-only values passed, otherwise the texture
+//! is composited with a single quad.
+class ParamsOverlay
+{
+ public:
+	static ParamsOverlayRef create( const ci::params::InterfaceGlRef &params )
+	{ return ParamsOverlayRef( new ParamsOverlay( params ) ); }
+
+	~ParamsOverlay();
+
+	//! Without caching the params are drawn directly every frame.
+	void enableCache( bool enabled = true ) { mDirty = mDirty || enabled != mCacheEnabled; mCacheEnabled = enabled; }
+	void disableCache() { enableCache( false ); }
+	//! Redraws per second for values changing without input, like the fps.
+	void setRefreshRate( float hz ) { mRefreshInterval = 1.0 / std::max( hz, 0.1f ); }
+
+	//! The next draw renders the bars again.
+	void invalidate();
+
+	void draw();
+
+ protected:
+	ParamsOverlay( const ci::params::InterfaceGlRef &params );
+
+	void render( const ci::Vec2i &windowSize );
+
+	ci::params::InterfaceGlRef mParams;
+	// the bars over black and over white
+	ci::gl::Fbo mFbo;
+	ci::gl::GlslProg mCompositeShader;
+
+	bool mCacheEnabled = true;
+	double mRefreshInterval = 0.25;
+	double mLastRenderTime = 0.0;
+	size_t mLayoutHash = 0;
+	bool mDirty = true;
+
+	std::vector< ci::signals::connection > mConnections;
+};
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+
 #include "Config.h"
 
 namespace mndl { namespace params {
@@ -10,4 +12,9 @@ void addParamsLayoutVars( const mndl::ConfigRef &config );
 void readParamsLayout();
 void writeParamsLayout();
 
+//! Hash of the visibility, size, position and iconified state of all bars. It is cached,
+//! showAllParams() and readParamsLayout() invalidate it, other changes have to as well.
+size_t getParamsLayoutHash();
+void invalidateParamsLayoutHash();
+
 } } // namespace mndl::params
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <bitset>
+#include <cstdint>
+
+#include "cinder/Quaternion.h"
+#include "cinder/Vector.h"
+
+#include "Avatar.h"
+
+//! Joint values of a single frame. Only the joints set in the masks are valid.
+struct Pose
+{
+	int32_t mFrameId = -1;
+
+	ci::Quatf mOrientations[ Avatar::TOTAL_JOINTS ];
+	ci::Vec3f mPositions[ Avatar::TOTAL_JOINTS ];
+
+	std::bitset< Avatar::TOTAL_JOINTS > mOrientationMask;
+	std::bitset< Avatar::TOTAL_JOINTS > mPositionMask;
+
+	void clear()
+	{
+		mFrameId = -1;
+		mOrientationMask.reset();
+		mPositionMask.reset();
+	}
+};
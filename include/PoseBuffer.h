@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include "cinder/Vector.h"
+
+#include "Pose.h"
+
+typedef std::shared_ptr< class PoseBuffer > PoseBufferRef;
+
+//! Assembles joint messages into poses on the osc thread and hands complete
+//! frames to the render thread. A pose is published when all joint
+//! orientations of its frame arrived, a frame still incomplete when a newer
+//! one starts is dropped, so the render thread never sees joints from
+//! different frames.
+class PoseBuffer
+{
+ public:
+	static PoseBufferRef create() { return PoseBufferRef( new PoseBuffer() ); }
+
+	//! Thread-safe, messages for joints out of range or older frames are dropped.
+	void setPosition( int32_t frameId, size_t jointId, const ci::Vec3f &position );
+	//! Thread-safe, the euler angles are in BVH ZXY order.
+	void setOrientation( int32_t frameId, size_t jointId, const ci::Vec3f &eulerDegrees );
+	//! Thread-safe.
+	void setOrientation( int32_t frameId, size_t jointId, const ci::Quatf &orientation );
+	//! Thread-safe, publishes a pose received as a whole if it has all joint orientations.
+	void setPose( const Pose &pose );
+
+	//! Copies the latest published pose to \a pose if it changed since the last call.
+	bool getLatestPose( Pose *pose );
+
+	//! Like getLatestPose() without the copy, sets \a frameId to the id of the latest published pose.
+	bool takeLatestFrameId( int32_t *frameId );
+
+	//! Copies the published pose of \a frameId if it is among the recent ones.
+	bool getPose( int32_t frameId, Pose *pose );
+
+	//! Blocks until a pose is published that has not been taken yet or \a deadline passes.
+	//! Returns true if a new pose is available.
+	bool waitForPose( const std::chrono::steady_clock::time_point &deadline );
+
+	//! All dropped messages, the invalid ones and the late ones of superseded frames.
+	uint32_t getDroppedMessages() const { return mDroppedMessages; }
+	//! Messages dropped for an out of range joint id or a negative frame id.
+	uint32_t getInvalidMessages() const { return mInvalidMessages; }
+	//! Frames dropped because not all of their joint orientations arrived.
+	uint32_t getIncompleteFrames() const { return mIncompleteFrames; }
+	//! Times the frame ids started again from far behind, when the sender restarted.
+	uint32_t getRestarts() const { return mRestarts; }
+
+ protected:
+	PoseBuffer() {}
+
+	//! Returns false if the message has to be dropped, call with the mutex locked.
+	bool beginMessage( int32_t frameId, size_t jointId );
+	void publish();
+
+	std::mutex mMutex;
+	std::condition_variable mPoseCondition;
+	Pose mIncoming;
+	Pose mLatest;
+	// recently published poses by frame id, covers the presentation delay of the cluster
+	static const size_t HISTORY_SIZE = 64;
+	Pose mHistory[ HISTORY_SIZE ];
+	bool mLatestChanged = false;
+	std::atomic< uint32_t > mDroppedMessages { 0 };
+	std::atomic< uint32_t > mInvalidMessages { 0 };
+	std::atomic< uint32_t > mIncompleteFrames { 0 };
+	std::atomic< uint32_t > mRestarts { 0 };
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <algorithm>
+#include <bitset>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "cinder/Quaternion.h"
+#include "cinder/Vector.h"
+
+#include "Avatar.h"
+#include "Pose.h"
+
+typedef std::shared_ptr< class PoseEncoder > PoseEncoderRef;
+typedef std::shared_ptr< class PoseDecoder > PoseDecoderRef;
+
+/*
+ Compact binary pose, sent as the blob of a /pose message. All values are
+ little endian.
+
+	uint8   flags          bit 0 keyframe, bit 1 root position present
+	uint8   jointCount     number of joints of the sender
+	int32   frameId
+	int32   keyframeId     keyframe the delta refers to, frameId for keyframes
+	uint8   changed[ ( jointCount + 7 ) / 8 ]    joints with an orientation below
+	float32 rootPosition[ 3 ]                    if flag bit 1 is set
+	uint32  orientation for each changed joint   smallest three packed
+
+ Keyframes carry all joints. Delta frames carry the joints whose quantized
+ orientation differs from the keyframe, so a lost delta does not affect the
+ following ones. Only the root joint has a translation. A full pose of the
+ avatar is 291 bytes.
+*/
+namespace PoseCodec
+{
+	static const uint8_t FLAG_KEYFRAME = 1;
+	static const uint8_t FLAG_ROOT_POSITION = 2;
+	static const size_t HEADER_SIZE = 10;
+	static const size_t MASK_SIZE = ( Avatar::TOTAL_JOINTS + 7 ) / 8;
+	static const size_t MAX_SIZE = HEADER_SIZE + MASK_SIZE + 12 + Avatar::TOTAL_JOINTS * 4;
+
+	//! Packs the three smallest components of \a q with 10 bits each and the index of the largest one.
+	uint32_t packQuat( const ci::Quatf &q );
+	ci::Quatf unpackQuat( uint32_t packed );
+}
+
+//! Sender side of the pose encoding, keeps the last keyframe.
+class PoseEncoder
+{
+ public:
+	static PoseEncoderRef create() { return PoseEncoderRef( new PoseEncoder() ); }
+
+	//! Frames between keyframes, 1 sends keyframes only.
+	void setKeyframeInterval( int interval ) { mKeyframeInterval = std::max( interval, 1 ); }
+	//! The next frame is encoded as a keyframe.
+	void forceKeyframe() { mFramesSinceKeyframe = -1; }
+
+	//! Encodes the orientations and the root position of \a pose to \a data.
+	void encode( const Pose &pose, std::vector< uint8_t > *data );
+
+ protected:
+	PoseEncoder() {}
+
+	int mKeyframeInterval = 30;
+	int mFramesSinceKeyframe = -1;
+	int32_t mKeyframeId = -1;
+	std::bitset< Avatar::TOTAL_JOINTS > mKeyOrientationMask;
+	uint32_t mKeyOrientations[ Avatar::TOTAL_JOINTS ];
+	bool mKeyHasRootPosition = false;
+	ci::Vec3f mKeyRootPosition;
+};
+
+//! Receiver side of the pose encoding, one decoder per sender.
+class PoseDecoder
+{
+ public:
+	static PoseDecoderRef create() { return PoseDecoderRef( new PoseDecoder() ); }
+
+	//! Decodes \a data to \a pose. Returns false for malformed data and for
+	//! deltas of a keyframe that was not received.
+	bool decode( const uint8_t *data, size_t size, Pose *pose );
+
+	uint32_t getMissingKeyframes() const { return mMissingKeyframes; }
+
+ protected:
+	PoseDecoder() {}
+
+	int32_t mKeyframeId = -1;
+	std::bitset< Avatar::TOTAL_JOINTS > mKeyOrientationMask;
+	ci::Quatf mKeyOrientations[ Avatar::TOTAL_JOINTS ];
+	bool mKeyHasRootPosition = false;
+	ci::Vec3f mKeyRootPosition;
+
+	uint32_t mMissingKeyframes = 0;
+};
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+#include "cinder/DataSource.h"
+#include "cinder/Filesystem.h"
+
+#include "Avatar.h"
+#include "Pose.h"
+
+typedef std::shared_ptr< class PoseDatabase > PoseDatabaseRef;
+
+/*
+ Recorded poses searchable by similarity. Each frame is a feature vector of
+ the joint orientations with w >= 0, stored as structure of arrays in one
+ contiguous block, x of all joints, then y, z and w. The distance is the
+ euclidean distance of the features and the frames are indexed with a
+ vantage point tree.
+
+ Sessions are binary files, all values little endian:
+
+	char    magic[ 4 ]       "AIPS"
+	uint32  version          1
+	uint32  jointCount
+	uint32  frameCount
+	float32 rate             frames per second
+	float32 orientations[ frameCount ][ jointCount ][ 4 ]    x y z w
+*/
+class PoseDatabase
+{
+ public:
+	static PoseDatabaseRef create() { return PoseDatabaseRef( new PoseDatabase() ); }
+
+	//! Adds the frames of a session file, call buildIndex() after the last one.
+	bool addSession( const ci::DataSourceRef &source );
+	//! Adds \a poses recorded at \a rate frames per second as a session.
+	void addSession( const std::vector< Pose > &poses, float rate );
+	static bool writeSession( const ci::fs::path &path, const std::vector< Pose > &poses, float rate );
+
+	//! Writes a session frame by frame, a recording does not have to fit in memory.
+	class SessionWriter
+	{
+	 public:
+		//! Check isOpen() after the construction.
+		SessionWriter( const ci::fs::path &path );
+
+		bool isOpen() const { return mStream.is_open(); }
+		void addPose( const Pose &pose );
+		size_t getNumFrames() const { return mNumFrames; }
+		//! Completes the header with the frame count and \a rate, then closes the file.
+		bool close( float rate );
+
+	 protected:
+		std::ofstream mStream;
+		size_t mNumFrames = 0;
+	};
+
+	void buildIndex();
+
+	//! Limits the distance evaluations of a search, 0 searches exhaustively.
+	void setMaxVisits( size_t visits ) { mMaxVisits = visits; }
+	//! A visit reads a whole feature of about a kilobyte, this many keep a search of millions of
+	//! frames well below a millisecond.
+	static const size_t DEFAULT_MAX_VISITS = 500;
+
+	//! Returns the frame closest to the orientations of \a pose, npos if the database is empty.
+	size_t findNearest( const Pose &pose ) const;
+	//! Linear search for reference.
+	size_t findNearestLinear( const Pose &pose ) const;
+
+	//! Returns the frame following \a frame in its session, npos at the end of the session.
+	size_t getNextFrame( size_t frame ) const;
+	//! Frames per second of the session of \a frame.
+	float getRate( size_t frame ) const;
+	//! Sets all orientations of \a pose to \a frame.
+	void getPose( size_t frame, Pose *pose ) const;
+
+	size_t getNumFrames() const { return mNumFrames; }
+	size_t getNumSessions() const { return mSessions.size(); }
+
+	static const size_t npos = size_t( -1 );
+
+ protected:
+	PoseDatabase() {}
+
+	static const size_t N = Avatar::TOTAL_JOINTS;
+	// one feature, padded to a multiple of 8 floats for the distance kernel
+	static const size_t FEATURE_SIZE = ( 4 * N + 7 ) & ~size_t( 7 );
+
+	//! Adds a session of \a numFrames frames with uninitialized features, returns its first frame.
+	size_t beginSession( size_t numFrames, float rate );
+	float * getFeature( size_t frame ) { return &mFeatures[ frame * FEATURE_SIZE ]; }
+	const float * getFeature( size_t frame ) const { return &mFeatures[ frame * FEATURE_SIZE ]; }
+	static void poseToFeature( const Pose &pose, float *feature );
+	static void setFeatureJoint( size_t joint, const ci::Quatf &q, float *feature );
+	static float distanceSq( const float *a, const float *b );
+
+	void build( size_t begin, size_t end, float *distances );
+	void search( size_t begin, size_t end, const float *query,
+				 size_t *best, float *bestDistance, size_t *visits ) const;
+
+	struct Session
+	{
+		size_t mFirstFrame;
+		size_t mNumFrames;
+		float mRate;
+	};
+	std::vector< Session > mSessions;
+	// session of each frame
+	std::vector< uint32_t > mFrameSessions;
+
+	std::vector< float > mFeatures;
+	size_t mNumFrames = 0;
+
+	// the tree is stored in place: the vantage point of the range [begin, end) is at
+	// begin, the points inside its radius are in ( begin, mid ], the rest in ( mid, end )
+	std::vector< uint32_t > mTreeFrames;
+	std::vector< float > mTreeRadii;
+	size_t mMaxVisits = 0;
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <memory>
+
+#include "Avatar.h"
+#include "Pose.h"
+
+typedef std::shared_ptr< class PoseFilter > PoseFilterRef;
+
+//! One Euro filter for the joint positions and adaptive quaternion smoothing
+//! for the orientations. The state is kept as structure of arrays and all
+//! joints are filtered in one pass per pose, so the joint loops vectorize.
+class PoseFilter
+{
+ public:
+	static PoseFilterRef create() { return PoseFilterRef( new PoseFilter() ); }
+
+	//! Cutoff frequency in Hz at rest and its increase per unit/s of speed.
+	void setPositionParams( float minCutoff, float beta );
+	//! Cutoff frequency in Hz at rest and its increase per rad/s of angular speed.
+	void setOrientationParams( float minCutoff, float beta );
+	//! Cutoff frequency in Hz of the speed estimation.
+	void setDerivativeCutoff( float cutoff ) { mDerivativeCutoff = cutoff; }
+
+	//! Filters the joints present in \a pose in place, \a time is the arrival time of the pose in seconds.
+	void filter( Pose *pose, double time );
+	//! The next pose passes unfiltered and restarts the filter.
+	void reset();
+
+ protected:
+	PoseFilter();
+
+	void filterPositions( float dt );
+	void filterOrientations( float dt );
+
+	static const size_t N = Avatar::TOTAL_JOINTS;
+
+	float mPositionMinCutoff = 1.0f;
+	float mPositionBeta = 0.01f;
+	float mOrientationMinCutoff = 1.0f;
+	float mOrientationBeta = 0.5f;
+	float mDerivativeCutoff = 1.0f;
+
+	double mLastTime = -1.0;
+
+	// input of the current pose, the masks are 1 for joints present in the pose
+	float mInPosition[ 3 ][ N ];
+	float mInPositionMask[ N ];
+	float mInOrientation[ 4 ][ N ];
+	float mInOrientationMask[ N ];
+
+	// filtered state, the valid flags are 1 for joints that have been filtered once
+	float mPosition[ 3 ][ N ];
+	float mPositionSpeed[ N ];
+	float mPositionValid[ N ];
+	float mOrientation[ 4 ][ N ];
+	float mOrientationSpeed[ N ];
+	float mOrientationValid[ N ];
+};
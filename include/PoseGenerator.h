@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include "cinder/Vector.h"
+
+#include "Avatar.h"
+
+typedef std::shared_ptr< class PoseGenerator > PoseGeneratorRef;
+
+//! Deterministic procedural poses for all avatar joints. The same seed,
+//! rate, noise and frame id always give the same pose.
+class PoseGenerator
+{
+ public:
+	static PoseGeneratorRef create( uint32_t seed = 0 )
+	{ return PoseGeneratorRef( new PoseGenerator( seed ) ); }
+
+	//! Pose frames per second, sets the motion speed per frame id.
+	void setRate( float rate ) { mRate = rate; }
+	float getRate() const { return mRate; }
+
+	//! Amplitude of the per-frame noise in degrees.
+	void setNoise( float noiseDegrees ) { mNoise = noiseDegrees; }
+	float getNoise() const { return mNoise; }
+
+	void generate( int32_t frameId );
+
+	int32_t getFrameId() const { return mFrameId; }
+	const ci::Vec3f & getEulerDegrees( size_t jointId ) const { return mEulerDegrees[ jointId ]; }
+	const ci::Vec3f & getRootPosition() const { return mRootPosition; }
+
+	//! Sets the generated pose on \a avatar.
+	void apply( const AvatarRef &avatar ) const;
+
+ protected:
+	PoseGenerator( uint32_t seed );
+
+	uint32_t mSeed;
+	float mRate = 30.0f;
+	float mNoise = 1.0f;
+
+	// per joint motion parameters derived from the seed
+	ci::Vec3f mAmplitudes[ Avatar::TOTAL_JOINTS ];
+	ci::Vec3f mFrequencies[ Avatar::TOTAL_JOINTS ];
+	ci::Vec3f mPhases[ Avatar::TOTAL_JOINTS ];
+
+	int32_t mFrameId = -1;
+	ci::Vec3f mEulerDegrees[ Avatar::TOTAL_JOINTS ];
+	ci::Vec3f mRootPosition;
+};
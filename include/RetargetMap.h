@@ -0,0 +1,60 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cinder/DataSource.h"
+#include "cinder/Quaternion.h"
+
+typedef std::shared_ptr< class RetargetMap > RetargetMapRef;
+
+/*
+ Maps the incoming joints to the nodes of a skeleton. The map is an xml
+ file with one entry per driven node:
+
+	<retarget>
+		<joint source="LShoulder" target="mixamorig:LeftArm" positionScale="1">
+			<pre x="0" y="0" z="0" w="1" />
+			<post x="0" y="0" z="0" w="1" />
+		</joint>
+	</retarget>
+
+ source is an Avatar joint name or id. The incoming orientation q is applied
+ as pre * q * post in ci::Quatf order, where pre and post are the rest pose
+ offsets between the source and the target skeleton. Missing offsets are
+ identity, unless the root is <retarget offsets="bind">: then the entries
+ without offsets get them from the bind pose of the model when the avatar
+ is created. The derived offsets assume that the source rest pose has
+ identity world orientations, and that the bind pose of the model is the
+ same pose, for example both are a T-pose. The incoming rotations are then
+ applied on top of the bind pose.
+*/
+class RetargetMap
+{
+ public:
+	static RetargetMapRef create() { return RetargetMapRef( new RetargetMap() ); }
+	static RetargetMapRef create( const ci::DataSourceRef &source )
+	{ return RetargetMapRef( new RetargetMap( source ) ); }
+	//! One to one map of the Avatar joints to nodes with the same name.
+	static RetargetMapRef createDefault();
+
+	struct Entry
+	{
+		size_t mSourceId;
+		std::string mTargetName;
+		ci::Quatf mPreOffset;
+		ci::Quatf mPostOffset;
+		float mPositionScale = 1.0f;
+		//! The offsets are derived from the bind pose by the avatar.
+		bool mBindOffsets = false;
+	};
+
+	const std::vector< Entry > & getEntries() const { return mEntries; }
+
+ protected:
+	RetargetMap() {}
+	RetargetMap( const ci::DataSourceRef &source );
+
+	std::vector< Entry > mEntries;
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+//! Bounded lock-free queue for one producer and one consumer thread.
+template< typename T >
+class SpscQueue
+{
+ public:
+	//! \a capacity is rounded up to a power of two.
+	SpscQueue( size_t capacity ) :
+		mHead( 0 ), mTail( 0 )
+	{
+		size_t size = 1;
+		while ( size < capacity )
+		{
+			size <<= 1;
+		}
+		mItems.resize( size );
+		mMask = size - 1;
+	}
+
+	//! Producer side, returns false if the queue is full.
+	bool push( const T &item )
+	{
+		size_t tail = mTail.load( std::memory_order_relaxed );
+		if ( tail - mHead.load( std::memory_order_acquire ) > mMask )
+		{
+			return false;
+		}
+		mItems[ tail & mMask ] = item;
+		mTail.store( tail + 1, std::memory_order_release );
+		return true;
+	}
+
+	//! Consumer side, returns false if the queue is empty.
+	bool pop( T *item )
+	{
+		size_t head = mHead.load( std::memory_order_relaxed );
+		if ( head == mTail.load( std::memory_order_acquire ) )
+		{
+			return false;
+		}
+		*item = mItems[ head & mMask ];
+		mHead.store( head + 1, std::memory_order_release );
+		return true;
+	}
+
+	size_t getCapacity() const { return mMask + 1; }
+
+ protected:
+	std::vector< T > mItems;
+	size_t mMask;
+	// head and tail on separate cache lines, they are written by different threads
+	alignas( 64 ) std::atomic< size_t > mHead;
+	alignas( 64 ) std::atomic< size_t > mTail;
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::shared_ptr< class StagedStartup > StagedStartupRef;
+
+//! Loads the application in stages while it already runs. The cpu part of
+//! a stage runs on a worker thread, then its main thread part, typically the
+//! gpu upload, is called from update() within a time budget per frame.
+class StagedStartup
+{
+ public:
+	static StagedStartupRef create( size_t numWorkers = 2 )
+	{ return StagedStartupRef( new StagedStartup( numWorkers ) ); }
+
+	//! Waits for the running worker functions, the stages not started yet are dropped.
+	~StagedStartup();
+
+	//! \a workerFn runs on a worker thread, then \a mainFn is called on the main thread
+	//! repeatedly within the budget of update() until it returns true, a call should do a
+	//! chunk of work. Either can be empty. Add all stages before start().
+	void addStage( const std::string &name, const std::function< void () > &workerFn,
+				   const std::function< bool () > &mainFn = std::function< bool () >() );
+
+	void start();
+
+	//! Calls the main thread functions of the stages whose worker part finished until
+	//! \a budgetMs passed. At least one call is made, a single call can take longer.
+	void update( double budgetMs );
+
+	bool isDone() const { return mNumDone == mStages.size(); }
+	//! Name of the first stage not finished yet, empty when done.
+	std::string getStatus() const;
+
+ protected:
+	StagedStartup( size_t numWorkers ) : mNumWorkers( numWorkers ) {}
+
+	void runWorker();
+
+	struct Stage
+	{
+		std::string mName;
+		std::function< void () > mWorkerFn;
+		std::function< bool () > mMainFn;
+		std::atomic< bool > mWorkerDone { false };
+		bool mDone = false;
+	};
+	std::vector< std::unique_ptr< Stage > > mStages;
+	size_t mNumDone = 0;
+
+	size_t mNumWorkers;
+	std::vector< std::thread > mWorkers;
+	std::atomic< size_t > mNextWorkerStage { 0 };
+	std::atomic< bool > mCancelled { false };
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cinder/Filesystem.h"
+#include "cinder/gl/gl.h"
+
+#include "SpscQueue.h"
+
+struct AVCodecContext;
+struct AVFormatContext;
+struct AVFrame;
+struct AVPacket;
+struct AVStream;
+struct SwsContext;
+
+typedef std::shared_ptr< class VideoRecorder > VideoRecorderRef;
+
+//! Records the default framebuffer to a video file. Frames are read back
+//! asynchronously through pixel buffer objects and encoded with libav on a
+//! background thread. When the encoder falls behind frames are dropped
+//! instead of blocking the render loop.
+class VideoRecorder
+{
+ public:
+	struct Format
+	{
+		std::string mCodec = "libx264";
+		int mFps = 30;
+		int mCrf = 20;
+		std::string mPreset = "veryfast";
+		//! Number of frames that can wait for the encoder.
+		size_t mQueueSize = 8;
+	};
+
+	static VideoRecorderRef create( const ci::fs::path &path, int width, int height,
+									const Format &format = Format() )
+	{ return VideoRecorderRef( new VideoRecorder( path, width, height, format ) ); }
+
+	//! Calls finish() and waits until the encoder closed the file.
+	~VideoRecorder();
+
+	//! Reads back the frames still in flight and returns at once, the encoder thread encodes the queued
+	//! frames and closes the file. Nothing is captured afterwards, release the recorder once isFinished().
+	void finish();
+	bool isFinished() const { return mFinished; }
+
+	//! Reads back the current framebuffer, call at the end of draw(). \a time is
+	//! the time since the start of the recording in seconds.
+	void captureFrame( double time );
+
+	bool isOpen() const { return mOpen; }
+	uint32_t getCapturedFrames() const { return mCapturedFrames; }
+	uint32_t getEncodedFrames() const { return mEncodedFrames; }
+	uint32_t getDroppedFrames() const { return mDroppedFrames; }
+
+ protected:
+	VideoRecorder( const ci::fs::path &path, int width, int height, const Format &format );
+
+	bool openEncoder( const ci::fs::path &path );
+	void closeEncoder();
+
+	struct Frame
+	{
+		std::vector< uint8_t > mPixels;
+		int64_t mPts;
+	};
+
+	void queuePbo( size_t pboIndex );
+	void encodeFrames();
+	void encodeFrame( const Frame *frame );
+	void writePackets();
+
+	int mWidth;
+	int mHeight;
+	Format mFormat;
+	bool mOpen = false;
+	bool mFinishing = false;
+	std::atomic< bool > mFinished { false };
+
+	// frames read back earlier are mapped a few frames later, when the transfer finished
+	static const size_t NUM_PBOS = 3;
+	GLuint mPbos[ NUM_PBOS ];
+	int64_t mPboPts[ NUM_PBOS ];
+	size_t mPboIndex = 0;
+	int64_t mLastPts = -1;
+
+	std::vector< std::unique_ptr< Frame > > mFrames;
+	// single producer queues, the encoder thread returns the frames the main thread fills
+	SpscQueue< Frame * > mFreeFrames;
+	SpscQueue< Frame * > mQueuedFrames;
+
+	std::thread mEncoderThread;
+	std::atomic< bool > mEncoderRunning { false };
+	std::mutex mEncoderMutex;
+	std::condition_variable mEncoderCondition;
+
+	std::atomic< uint32_t > mCapturedFrames { 0 };
+	std::atomic< uint32_t > mEncodedFrames { 0 };
+	std::atomic< uint32_t > mDroppedFrames { 0 };
+
+	AVFormatContext *mFormatContext = nullptr;
+	AVCodecContext *mCodecContext = nullptr;
+	AVStream *mStream = nullptr;
+	AVFrame *mAvFrame = nullptr;
+	AVPacket *mPacket = nullptr;
+	SwsContext *mSwsContext = nullptr;
+};
@@ -1,9 +1,14 @@
+#include <algorithm>
+#include <ctime>
+#include <fstream>
 #include <vector>
 
+#include "cinder/Buffer.h"
 #include "cinder/Camera.h"
 #include "cinder/Cinder.h"
 #include "cinder/MayaCamUI.h"
 #include "cinder/TriMesh.h"
+#include "cinder/Utilities.h"
 #include "cinder/app/App.h"
 #include "cinder/app/AppNative.h"
 #include "cinder/gl/DisplayList.h"
@@ -11,9 +16,22 @@
 #include "cinder/params/Params.h"
 
 #include "Avatar.h"
+#include "ClusterSync.h"
 #include "Config.h"
+#include "DynamicResolution.h"
+#include "FootGrounding.h"
+#include "FrameScheduler.h"
+#include "LatencyStats.h"
+#include "MotionTrails.h"
 #include "OscServer.h"
+#include "ParamsOverlay.h"
 #include "ParamsUtils.h"
+#include "PoseBuffer.h"
+#include "PoseCodec.h"
+#include "PoseDatabase.h"
+#include "PoseFilter.h"
+#include "StagedStartup.h"
+#include "VideoRecorder.h"
 
 using namespace ci;
 using namespace ci::app;
@@ -35,11 +53,29 @@ class AIamRendererApp : public AppNative
 
  private:
 	params::InterfaceGlRef mParams;
+	ParamsOverlayRef mParamsOverlay;
+	bool mParamsCacheEnabled;
+	float mParamsRefreshRate;
 
 	void setupParams();
+	void setupConfigChangedFns();
+
+	StagedStartupRef mStartup;
+	void setupStartup();
+	//! Main thread time spent on loading per frame in ms.
+	static constexpr double STARTUP_FRAME_BUDGET = 4.0;
+	//! Vertices and indices of the ghost skin uploaded per frame while loading.
+	static const size_t SKIN_UPLOAD_ELEMENTS = 65536;
 
 	float mFps;
 	bool mVerticalSyncEnabled = false;
+
+	FrameSchedulerRef mFrameScheduler;
+	bool mFramePacing;
+	float mRefreshRate;
+	float mIdleFps;
+	float mPacingMargin;
+	float mPredictedFrameCost;
 	bool mDebugDrawOrigin = false;
 
 	TriMesh createSquare( const Vec2i &resolution );
@@ -67,15 +103,114 @@ class AIamRendererApp : public AppNative
 	void setupOsc();
 
 	mndl::osc::Server mListener;
-	std::mutex mOscMutex;
+	int mOscPort;
+	PoseBufferRef mPoseBuffer;
+	uint32_t mPoseRestarts = 0;
+	Pose mPose;
+	void applyPose();
+
+	PoseFilterRef mPoseFilter;
+	bool mFilterEnabled;
+	float mFilterPositionMinCutoff;
+	float mFilterPositionBeta;
+	float mFilterOrientationMinCutoff;
+	float mFilterOrientationBeta;
+	float mFilterDerivativeCutoff;
 
 	bool orientationReceived( const mndl::osc::Message &message );
 	bool translationReceived( const mndl::osc::Message &message );
+	bool poseReceived( const mndl::osc::Message &message );
+	PoseDecoderRef mPoseDecoder;
+	Pose mDecodedPose;
 
-	uint32_t orientationHandlerId;
-	uint32_t translationHandlerId;
+	std::vector< uint32_t > mOscHandlerIds;
 
 	AvatarRef mAvatar;
+
+	// the joint history of the trails and the ghosts
+	MotionTrailsRef mMotionTrails;
+	std::vector< size_t > mTrailJoints;
+	bool mDrawTrails;
+	int mTrailLength;
+	float mTrailWidth;
+	ColorA mTrailColor;
+	int mGhostCount;
+	int mGhostSpacing;
+	ColorA mGhostColor;
+
+	// keeps the feet on the plane
+	FootGroundingRef mFootGrounding;
+	bool mGroundingEnabled;
+	bool mGroundingArms;
+	float mGroundingFootHeight;
+	float mGroundingHandHeight;
+	float mGroundingContactEnter;
+	float mGroundingContactExit;
+	float mGroundingHipSmoothing;
+
+	DynamicResolutionRef mDynamicResolution;
+	bool mDynamicResolutionEnabled;
+	float mResolutionTargetTime;
+	float mResolutionMinScale;
+	float mResolutionScale;
+	float mSceneGpuTime;
+
+	ClusterSyncRef mClusterSync;
+	int mClusterMode;
+	std::string mClusterPeerHost;
+	int mClusterPeerPort;
+	int mClusterFollowerId;
+	float mClusterPresentationDelay;
+	float mClusterLag;
+	void setupClusterSync();
+
+	LatencyStatsRef mLatencyStats;
+	float mLatencyStageMeans[ LatencyStats::NUM_STAGES ];
+	float mLatencyTotalP95;
+	float mLatencyTotalP99;
+	int mLatencySupersededFrames;
+	int mDroppedPoseMessages;
+	int mIncompletePoseFrames;
+	float mStatsExportInterval;
+	double mLastStatsExportTime = 0.0;
+	std::ofstream mStatsFile;
+	void updateLatencyStats();
+
+	VideoRecorderRef mVideoRecorder;
+	// stopped recorders until their encoders closed the files
+	std::vector< VideoRecorderRef > mFinishingRecorders;
+	double mRecordingStartTime;
+	int mRecordingFps;
+	int mRecordingCrf;
+	bool mRecording = false;
+	int mRecordedFrames = 0;
+	int mDroppedVideoFrames = 0;
+	void startRecording();
+	void stopRecording();
+
+	// recorded poses continue the motion when the stream stalls
+	PoseDatabaseRef mPoseDatabase;
+	bool mDropoutFillEnabled;
+	float mDropoutTimeout;
+	float mDropoutBlendTime;
+	int mDatabaseMaxVisits;
+	int mDatabaseFrames = 0;
+	double mLastPoseTime = 0.0;
+	size_t mFillFrame = PoseDatabase::npos;
+	double mFillStartTime;
+	double mFillFrameTime;
+	Pose mHeldPose;
+	Pose mFillPose;
+	static PoseDatabaseRef loadPoseDatabase();
+	void updateDropoutFill( double time );
+
+	bool mRecordingPoses = false;
+	double mPoseRecordingStartTime;
+	// the recorded poses go to the session file as they arrive
+	std::shared_ptr< PoseDatabase::SessionWriter > mPoseSessionWriter;
+	fs::path mPoseSessionPath;
+	void startPoseRecording();
+	void stopPoseRecording();
 };
 
 void AIamRendererApp::prepareSettings( Settings *settings )
@@ -86,17 +221,19 @@ void AIamRendererApp::prepareSettings( Settings *settings )
 void AIamRendererApp::setup()
 {
 	mConfig = mndl::Config::create();
-
+	mLatencyStats = LatencyStats::create();
+	mPoseFilter = PoseFilter::create();
+	mFrameScheduler = FrameScheduler::create();
+	mDynamicResolution = DynamicResolution::create();
+	mMotionTrails = MotionTrails::create();
+	mFootGrounding = FootGrounding::create();
+	mTrailJoints = { Avatar::LHAND, Avatar::RHAND, Avatar::LFOOT, Avatar::RFOOT };
+
+	// the frame scheduler paces the loop
 	disableFrameRate();
 
 	setupParams();
-
-	mAvatar = Avatar::create( getAssetPath( "model/avatar.dae" ) );
-
-	setupOsc();
-
-	createGrid();
-    mTriMeshPlane = createSquare( Vec2i( 64, 64 ) );
+	mParamsOverlay = ParamsOverlay::create( mParams );
 
 	mndl::params::addParamsLayoutVars( mConfig );
 
@@ -107,23 +244,146 @@ void AIamRendererApp::setup()
 		mndl::params::readParamsLayout();
 	}
 
-	gl::enableVerticalSync( mVerticalSyncEnabled );
+	// poses are received from the start, the avatar takes the latest one when it is loaded
+	mPoseBuffer = PoseBuffer::create();
+	setupOsc();
+	setupClusterSync();
+	setupConfigChangedFns();
+
 	mCamera.setPerspective( mCameraFov, getWindowAspectRatio(), 0.1f, 10000.0f );
 	mCamera.setEyePoint( mCameraEyePoint );
 	mCamera.setCenterOfInterestPoint( mCameraCenterOfInterestPoint );
 	mCamera.setOrientation( mCameraOrientation );
+
+	// the assets load while the window is already drawn
+	setupStartup();
+}
+
+void AIamRendererApp::setupStartup()
+{
+	mStartup = StagedStartup::create();
+
+	// the model is imported and its meshes converted on a worker, unless the loader has to create textures
+	auto retargetMap = std::make_shared< RetargetMapRef >();
+	auto avatar = std::make_shared< AvatarRef >();
+	auto importOnMain = std::make_shared< bool >( false );
+	auto skin = std::make_shared< Avatar::Skin >();
+	mStartup->addStage( "avatar",
+			[ retargetMap, avatar, importOnMain, skin ]()
+			{
+				// an optional retarget map next to the model maps the joints to other node names
+				fs::path retargetPath = getAssetPath( "model/avatar-retarget.xml" );
+				if ( ! retargetPath.empty() )
+				{
+					*retargetMap = RetargetMap::create( loadFile( retargetPath ) );
+				}
+
+				fs::path modelPath = getAssetPath( "model/avatar.dae" );
+				*importOnMain = Avatar::hasTextures( modelPath );
+				if ( ! *importOnMain )
+				{
+					*avatar = Avatar::create( modelPath, *retargetMap );
+					if ( *avatar )
+					{
+						( *avatar )->getSkin( modelPath, skin.get() );
+					}
+				}
+			},
+			[ this, retargetMap, avatar, importOnMain, skin ]()
+			{
+				if ( *importOnMain )
+				{
+					fs::path modelPath = getAssetPath( "model/avatar.dae" );
+					*avatar = Avatar::create( modelPath, *retargetMap );
+					if ( *avatar )
+					{
+						( *avatar )->getSkin( modelPath, skin.get() );
+					}
+					*importOnMain = false;
+					return false;
+				}
+
+				// the ghost skin goes to the gpu over a few frames
+				if ( ! mMotionTrails->uploadSkin( *skin, SKIN_UPLOAD_ELEMENTS ) )
+				{
+					return false;
+				}
+
+				// stays empty if the import failed on the worker, the app waits without an avatar
+				mAvatar = *avatar;
+				return true;
+			} );
+
+	auto plane = std::make_shared< TriMesh >();
+	mStartup->addStage( "plane",
+			[ this, plane ]() { *plane = createSquare( Vec2i( 64, 64 ) ); },
+			[ this, plane ]()
+			{
+				mTriMeshPlane = *plane;
+				return true;
+			} );
+
+	mStartup->addStage( "grid", std::function< void () >(),
+			[ this ]()
+			{
+				createGrid();
+				return true;
+			} );
+
+	auto database = std::make_shared< PoseDatabaseRef >();
+	mStartup->addStage( "pose database",
+			[ database ]() { *database = loadPoseDatabase(); },
+			[ this, database ]()
+			{
+				// the worker leaves it empty if the sessions failed to load, then there is nothing to fill with
+				mPoseDatabase = *database ? *database : PoseDatabase::create();
+				mPoseDatabase->setMaxVisits( mDatabaseMaxVisits );
+				mDatabaseFrames = static_cast< int >( mPoseDatabase->getNumFrames() );
+				return true;
+			} );
+
+	mStartup->start();
 }
 
 void AIamRendererApp::setupParams()
 {
 	mParams = params::InterfaceGl::create( "Parameters", Vec2i( 250, 400 ) );
 	mParams->addParam( "Fps", &mFps, true );
-	mParams->addParam( "Vertical sync", &mVerticalSyncEnabled ).updateFn(
-			[ & ]() { gl::enableVerticalSync( mVerticalSyncEnabled ); } );
+	mParams->addParam( "Vertical sync", &mVerticalSyncEnabled );
 	mParams->addSeparator();
 
 	mConfig->addVar( "Options/VSync", &mVerticalSyncEnabled, true );
 
+	mParams->addParam( "Cache params", &mParamsCacheEnabled );
+	mParams->addParam( "Params refresh rate", &mParamsRefreshRate ).min( 0.1f ).max( 60.0f );
+	mParams->addSeparator();
+
+	mConfig->addVar( "Options/ParamsCache", &mParamsCacheEnabled, true );
+	mConfig->addVar( "Options/ParamsRefreshRate", &mParamsRefreshRate, 4.0f );
+
+	mParams->addParam( "Frame pacing", &mFramePacing );
+	mParams->addParam( "Refresh rate", &mRefreshRate ).min( 1.0f ).max( 240.0f );
+	mParams->addParam( "Idle fps", &mIdleFps ).min( 0.1f ).max( 240.0f );
+	mParams->addParam( "Pacing margin (ms)", &mPacingMargin ).min( 0.0f ).max( 20.0f ).step( 0.1f );
+	mParams->addParam( "Predicted cost (ms)", &mPredictedFrameCost, true );
+	mParams->addSeparator();
+
+	mConfig->addVar( "Options/FramePacing", &mFramePacing, true );
+	mConfig->addVar( "Options/RefreshRate", &mRefreshRate, 60.0f );
+	mConfig->addVar( "Options/IdleFps", &mIdleFps, 30.0f );
+	mConfig->addVar( "Options/PacingMargin", &mPacingMargin, 2.0f );
+
+	mParams->addParam( "Dynamic resolution", &mDynamicResolutionEnabled );
+	mParams->addParam( "Scene gpu target (ms)", &mResolutionTargetTime ).min( 1.0f ).max( 100.0f ).step( 0.5f );
+	mParams->addParam( "Min resolution scale", &mResolutionMinScale ).min( 0.25f ).max( 1.0f ).step( 0.05f );
+	mParams->addParam( "Resolution scale", &mResolutionScale, true );
+	mParams->addParam( "Scene gpu (ms)", &mSceneGpuTime, true );
+	mParams->addSeparator();
+
+	mConfig->addVar( "Options/DynamicResolution", &mDynamicResolutionEnabled, true );
+	mConfig->addVar( "Options/ResolutionTargetTime", &mResolutionTargetTime, 12.0f );
+	mConfig->addVar( "Options/ResolutionMinScale", &mResolutionMinScale, 0.5f );
+
 	mParams->addText( "Camera" );
 	mParams->addParam( "Fov", &mCameraFov ).min( 20.0f ).max( 179.0f ).step( 0.1f ).updateFn(
 		[ & ]()
@@ -164,32 +424,498 @@ void AIamRendererApp::setupParams()
 
 	mConfig->addVar( "Debug/EnableWireframe", &mEnableWireframe, false );
 	mConfig->addVar( "Debug/DrawPlane", &mDrawPlane, true );
-	mConfig->addVar( "Debug/DrawPlane", &mDrawPlane, true );
 	mConfig->addVar( "Debug/DrawGrid", &mDrawGrid, true );
 	mConfig->addVar( "Debug/GridSize", &mGridSize, 50 );
 
 	mParams->addSeparator();
+
+	int maxHistory = static_cast< int >( mMotionTrails->getNumFrames() ) - 1;
+	mParams->addText( "Trails" );
+	mParams->addParam( "Draw trails", &mDrawTrails );
+	mParams->addParam( "Trail length", &mTrailLength ).min( 1 ).max( maxHistory );
+	mParams->addParam( "Trail width", &mTrailWidth ).min( 0.0f ).max( 100.0f ).step( 0.5f );
+	mParams->addParam( "Trail color", &mTrailColor );
+	mParams->addParam( "Ghosts", &mGhostCount ).min( 0 ).max( maxHistory );
+	mParams->addParam( "Ghost spacing", &mGhostSpacing ).min( 1 ).max( maxHistory );
+	mParams->addParam( "Ghost color", &mGhostColor );
+
+	mConfig->addVar( "Trails/Draw", &mDrawTrails, false );
+	mConfig->addVar( "Trails/Length", &mTrailLength, 120 );
+	mConfig->addVar( "Trails/Width", &mTrailWidth, 4.0f );
+	mConfig->addVar( "Trails/Color", &mTrailColor, ColorA( 1.0f, 0.6f, 0.2f, 0.8f ) );
+	mConfig->addVar( "Trails/GhostCount", &mGhostCount, 0 );
+	mConfig->addVar( "Trails/GhostSpacing", &mGhostSpacing, 10 );
+	mConfig->addVar( "Trails/GhostColor", &mGhostColor, ColorA( 0.6f, 0.8f, 1.0f, 0.6f ) );
+
+	mParams->addSeparator();
+
+	mParams->addText( "Grounding" );
+	mParams->addParam( "Foot grounding", &mGroundingEnabled );
+	mParams->addParam( "Ground hands", &mGroundingArms );
+	mParams->addParam( "Foot height", &mGroundingFootHeight ).min( 0.0f ).max( 100.0f ).step( 0.5f );
+	mParams->addParam( "Hand height", &mGroundingHandHeight ).min( 0.0f ).max( 100.0f ).step( 0.5f );
+	mParams->addParam( "Contact enter", &mGroundingContactEnter ).min( 0.0f ).max( 100.0f ).step( 0.5f );
+	mParams->addParam( "Contact exit", &mGroundingContactExit ).min( 0.0f ).max( 100.0f ).step( 0.5f );
+	mParams->addParam( "Hip smoothing (s)", &mGroundingHipSmoothing ).min( 0.0f ).max( 2.0f ).step( 0.01f );
+
+	mConfig->addVar( "Grounding/Enabled", &mGroundingEnabled, true );
+	mConfig->addVar( "Grounding/Arms", &mGroundingArms, false );
+	mConfig->addVar( "Grounding/FootHeight", &mGroundingFootHeight, 8.0f );
+	mConfig->addVar( "Grounding/HandHeight", &mGroundingHandHeight, 4.0f );
+	mConfig->addVar( "Grounding/ContactEnter", &mGroundingContactEnter, 2.0f );
+	mConfig->addVar( "Grounding/ContactExit", &mGroundingContactExit, 6.0f );
+	mConfig->addVar( "Grounding/HipSmoothing", &mGroundingHipSmoothing, 0.1f );
+
+	mParams->addSeparator();
+
+	mParams->addText( "Filter" );
+	mParams->addParam( "Filter enabled", &mFilterEnabled ).updateFn(
+			[ & ]() { mPoseFilter->reset(); } );
+	mParams->addParam( "Position min cutoff", &mFilterPositionMinCutoff ).min( 0.01f ).max( 30.0f ).step( 0.01f );
+	mParams->addParam( "Position beta", &mFilterPositionBeta ).min( 0.0f ).max( 10.0f ).step( 0.001f );
+	mParams->addParam( "Orientation min cutoff", &mFilterOrientationMinCutoff ).min( 0.01f ).max( 30.0f ).step( 0.01f );
+	mParams->addParam( "Orientation beta", &mFilterOrientationBeta ).min( 0.0f ).max( 10.0f ).step( 0.001f );
+	mParams->addParam( "Derivative cutoff", &mFilterDerivativeCutoff ).min( 0.01f ).max( 30.0f ).step( 0.01f );
+
+	mConfig->addVar( "Filter/Enabled", &mFilterEnabled, true );
+	mConfig->addVar( "Filter/PositionMinCutoff", &mFilterPositionMinCutoff, 1.0f );
+	mConfig->addVar( "Filter/PositionBeta", &mFilterPositionBeta, 0.01f );
+	mConfig->addVar( "Filter/OrientationMinCutoff", &mFilterOrientationMinCutoff, 1.0f );
+	mConfig->addVar( "Filter/OrientationBeta", &mFilterOrientationBeta, 0.5f );
+	mConfig->addVar( "Filter/DerivativeCutoff", &mFilterDerivativeCutoff, 1.0f );
+
+	mParams->addSeparator();
+
+	mParams->addText( "Recording" );
+	mParams->addParam( "Recording", &mRecording, true );
+	mParams->addParam( "Recorded frames", &mRecordedFrames, true );
+	mParams->addParam( "Dropped video frames", &mDroppedVideoFrames, true );
+	mParams->addParam( "Recording fps", &mRecordingFps ).min( 1 ).max( 120 );
+	mParams->addParam( "Recording crf", &mRecordingCrf ).min( 0 ).max( 51 );
+
+	mConfig->addVar( "Recording/Fps", &mRecordingFps, 30 );
+	mConfig->addVar( "Recording/Crf", &mRecordingCrf, 20 );
+
+	mParams->addSeparator();
+
+	mParams->addText( "Dropout" );
+	mParams->addParam( "Dropout fill", &mDropoutFillEnabled );
+	mParams->addParam( "Dropout timeout (ms)", &mDropoutTimeout ).min( 10.0f ).max( 5000.0f ).step( 10.0f );
+	mParams->addParam( "Fill blend time (s)", &mDropoutBlendTime ).min( 0.0f ).max( 5.0f ).step( 0.05f );
+	mParams->addParam( "Search max visits", &mDatabaseMaxVisits ).min( 0 ).updateFn(
+			[ & ]()
+			{
+				if ( mPoseDatabase )
+				{
+					mPoseDatabase->setMaxVisits( mDatabaseMaxVisits );
+				}
+			} );
+	mParams->addParam( "Database frames", &mDatabaseFrames, true );
+	mParams->addParam( "Recording poses", &mRecordingPoses, true );
+	mParams->addButton( "Record poses",
+			[ & ]()
+			{
+				if ( mRecordingPoses )
+					stopPoseRecording();
+				else
+					startPoseRecording();
+			} );
+
+	mConfig->addVar( "Dropout/Fill", &mDropoutFillEnabled, true );
+	mConfig->addVar( "Dropout/Timeout", &mDropoutTimeout, 200.0f );
+	mConfig->addVar( "Dropout/BlendTime", &mDropoutBlendTime, 0.5f );
+	mConfig->addVar( "Dropout/MaxVisits", &mDatabaseMaxVisits, int( PoseDatabase::DEFAULT_MAX_VISITS ) );
+
+	mParams->addSeparator();
+
+	mParams->addText( "Latency (ms)" );
+	for ( int i = 0; i < LatencyStats::NUM_STAGES; i++ )
+	{
+		mLatencyStageMeans[ i ] = 0.0f;
+		mParams->addParam( std::string( "Mean " ) +
+				LatencyStats::getStageName( LatencyStats::Stage( i ) ), &mLatencyStageMeans[ i ], true );
+	}
+	mParams->addParam( "P95 total", &mLatencyTotalP95, true );
+	mParams->addParam( "P99 total", &mLatencyTotalP99, true );
+	mParams->addParam( "Superseded frames", &mLatencySupersededFrames, true );
+	mParams->addParam( "Dropped messages", &mDroppedPoseMessages, true );
+	mParams->addParam( "Incomplete frames", &mIncompletePoseFrames, true );
+	mParams->addParam( "Stats export interval", &mStatsExportInterval ).min( 0.0f ).max( 600.0f ).step( 1.0f );
+	mParams->addButton( "Reset latency stats", [ & ]() { mLatencyStats->reset(); } );
+
+	mConfig->addVar( "Stats/ExportInterval", &mStatsExportInterval, 0.0f );
+
+	mParams->addSeparator();
+
+	mParams->addText( "Cluster" );
+	std::vector< std::string > clusterModeNames = { "off", "master", "follower" };
+	mParams->addParam( "Cluster mode", clusterModeNames, &mClusterMode ).updateFn(
+			[ & ]() { mClusterSync->setMode( ClusterSync::Mode( mClusterMode ) ); } );
+	mParams->addParam( "Peer hosts", &mClusterPeerHost ).updateFn(
+			[ & ]() { mClusterSync->setPeer( mClusterPeerHost, mClusterPeerPort ); } );
+	mParams->addParam( "Peer port", &mClusterPeerPort ).min( 1 ).max( 65535 ).updateFn(
+			[ & ]() { mClusterSync->setPeer( mClusterPeerHost, mClusterPeerPort ); } );
+	mParams->addParam( "Follower id", &mClusterFollowerId ).min( 0 ).updateFn(
+			[ & ]() { mClusterSync->setFollowerId( mClusterFollowerId ); } );
+	mParams->addParam( "Presentation delay (ms)", &mClusterPresentationDelay ).min( 0.0f ).max( 500.0f ).updateFn(
+			[ & ]() { mClusterSync->setPresentationDelay( mClusterPresentationDelay ); } );
+	mParams->addParam( "Cluster lag (ms)", &mClusterLag, true );
+
+	mConfig->addVar( "Osc/Port", &mOscPort, 10000 );
+	mConfig->addVar( "Cluster/Mode", &mClusterMode, 0 );
+	mConfig->addVar( "Cluster/PeerHost", &mClusterPeerHost, std::string( "127.0.0.1" ) );
+	mConfig->addVar( "Cluster/PeerPort", &mClusterPeerPort, 10000 );
+	mConfig->addVar( "Cluster/FollowerId", &mClusterFollowerId, 0 );
+	mConfig->addVar( "Cluster/PresentationDelay", &mClusterPresentationDelay, 50.0f );
+
+	mParams->addSeparator();
+}
+
+void AIamRendererApp::setupConfigChangedFns()
+{
+	// each function is called once now and again whenever its value changes
+	mConfig->setChangedFn( "Options/VSync",
+			[ & ]()
+			{
+				gl::enableVerticalSync( mVerticalSyncEnabled );
+				mFrameScheduler->setVerticalSync( mVerticalSyncEnabled );
+			} );
+	mConfig->setChangedFn( "Options/RefreshRate", [ & ]() { mFrameScheduler->setRefreshRate( mRefreshRate ); } );
+	mConfig->setChangedFn( "Options/IdleFps", [ & ]() { mFrameScheduler->setIdleRate( mIdleFps ); } );
+	mConfig->setChangedFn( "Options/PacingMargin", [ & ]() { mFrameScheduler->setMargin( mPacingMargin ); } );
+
+	mConfig->setChangedFn( "Options/DynamicResolution",
+			[ & ]() { mDynamicResolution->enable( mDynamicResolutionEnabled ); } );
+	mConfig->setChangedFn( "Options/ResolutionTargetTime",
+			[ & ]() { mDynamicResolution->setTargetTime( mResolutionTargetTime ); } );
+	mConfig->setChangedFn( "Options/ResolutionMinScale",
+			[ & ]() { mDynamicResolution->setMinScale( mResolutionMinScale ); } );
+
+	mConfig->setChangedFn( "Options/ParamsCache", [ & ]() { mParamsOverlay->enableCache( mParamsCacheEnabled ); } );
+	mConfig->setChangedFn( "Options/ParamsRefreshRate",
+			[ & ]() { mParamsOverlay->setRefreshRate( mParamsRefreshRate ); } );
+
+	auto positionParamsFn = [ & ]() { mPoseFilter->setPositionParams( mFilterPositionMinCutoff, mFilterPositionBeta ); };
+	mConfig->setChangedFn( "Filter/PositionMinCutoff", positionParamsFn );
+	mConfig->setChangedFn( "Filter/PositionBeta", positionParamsFn );
+	auto orientationParamsFn = [ & ]()
+			{ mPoseFilter->setOrientationParams( mFilterOrientationMinCutoff, mFilterOrientationBeta ); };
+	mConfig->setChangedFn( "Filter/OrientationMinCutoff", orientationParamsFn );
+	mConfig->setChangedFn( "Filter/OrientationBeta", orientationParamsFn );
+	mConfig->setChangedFn( "Filter/DerivativeCutoff",
+			[ & ]() { mPoseFilter->setDerivativeCutoff( mFilterDerivativeCutoff ); } );
+
+	// disabled the hip goes back to the height of the poses
+	mConfig->setChangedFn( "Grounding/Enabled",
+			[ & ]()
+			{
+				mFootGrounding->reset();
+				if ( mAvatar )
+				{
+					mAvatar->setRootOffset( Vec3f::zero() );
+				}
+				mMotionTrails->clear();
+			} );
+	mConfig->setChangedFn( "Grounding/Arms", [ & ]() { mFootGrounding->enableArms( mGroundingArms ); } );
+	mConfig->setChangedFn( "Grounding/FootHeight", [ & ]() { mFootGrounding->setFootHeight( mGroundingFootHeight ); } );
+	mConfig->setChangedFn( "Grounding/HandHeight", [ & ]() { mFootGrounding->setHandHeight( mGroundingHandHeight ); } );
+	auto contactFn = [ & ]() { mFootGrounding->setContactThresholds( mGroundingContactEnter, mGroundingContactExit ); };
+	mConfig->setChangedFn( "Grounding/ContactEnter", contactFn );
+	mConfig->setChangedFn( "Grounding/ContactExit", contactFn );
+	mConfig->setChangedFn( "Grounding/HipSmoothing",
+			[ & ]() { mFootGrounding->setHipSmoothing( mGroundingHipSmoothing ); } );
 }
 
 void AIamRendererApp::setupOsc()
 {
-	mListener = mndl::osc::Server( 10000 );
-	translationHandlerId = mListener.registerOscReceived(
-			&AIamRendererApp::translationReceived, this, "/translation", "iifff" );
-	orientationHandlerId = mListener.registerOscReceived(
-			&AIamRendererApp::orientationReceived, this, "/orientation", "iifff" );
+	mListener = mndl::osc::Server( mOscPort );
+	// the optional last argument is the sender timestamp in seconds since the epoch
+	for ( const std::string &typeTag : { "iifff", "iifffd" } )
+	{
+		mOscHandlerIds.push_back( mListener.registerOscReceived(
+				&AIamRendererApp::translationReceived, this, "/translation", typeTag ) );
+		mOscHandlerIds.push_back( mListener.registerOscReceived(
+				&AIamRendererApp::orientationReceived, this, "/orientation", typeTag ) );
+	}
+
+	// compact poses, see PoseCodec.h
+	mPoseDecoder = PoseDecoder::create();
+	for ( const std::string &typeTag : { "b", "bd" } )
+	{
+		mOscHandlerIds.push_back( mListener.registerOscReceived(
+				&AIamRendererApp::poseReceived, this, "/pose", typeTag ) );
+	}
+}
+
+void AIamRendererApp::setupClusterSync()
+{
+	mClusterSync = ClusterSync::create( &mListener );
+	mClusterSync->setMode( ClusterSync::Mode( mClusterMode ) );
+	mClusterSync->setPeer( mClusterPeerHost, mClusterPeerPort );
+	mClusterSync->setFollowerId( mClusterFollowerId );
+	mClusterSync->setPresentationDelay( mClusterPresentationDelay );
 }
 
 void AIamRendererApp::update()
 {
+	// the previous frame has been swapped by now
+	mLatencyStats->markSwapped();
+
+	// applies the values changed in the params
+	mConfig->update();
+
+	if ( ! mStartup->isDone() )
+	{
+		mStartup->update( STARTUP_FRAME_BUDGET );
+	}
+	else if ( mFramePacing )
+	{
+		mFrameScheduler->waitForFrame( mPoseBuffer );
+	}
+
 	mFps = getAverageFps();
 
+	// the poses wait in the buffer until the avatar is loaded
+	if ( ! mAvatar )
+	{
+		return;
+	}
+
+	// the trails would bridge the jump to the poses of a restarted sender
+	uint32_t poseRestarts = mPoseBuffer->getRestarts();
+	if ( poseRestarts != mPoseRestarts )
+	{
+		mPoseRestarts = poseRestarts;
+		mMotionTrails->clear();
+	}
+
+	ClusterSync::Mode clusterMode = mClusterSync->getMode();
+	if ( clusterMode != ClusterSync::MODE_OFF )
+	{
+		// the cluster displays the frames the master announced at their deadlines
+		int32_t latestFrameId = -1;
+		mPoseBuffer->takeLatestFrameId( &latestFrameId );
+		int32_t frameId = mClusterSync->beginFrame( latestFrameId );
+		if ( frameId != mPose.mFrameId && mPoseBuffer->getPose( frameId, &mPose ) )
+		{
+			applyPose();
+		}
+		mClusterLag = clusterMode == ClusterSync::MODE_MASTER ?
+					  mClusterSync->getMaxFollowerLag() : mClusterSync->getLag();
+	}
+	else
+	{
+		double now = getElapsedSeconds();
+		if ( mPoseBuffer->getLatestPose( &mPose ) )
+		{
+			applyPose();
+			mLastPoseTime = now;
+			// the stream resumes where it is, not where the fill was
+			if ( mFillFrame != PoseDatabase::npos )
+			{
+				mFillFrame = PoseDatabase::npos;
+				mMotionTrails->clear();
+			}
+		}
+		else if ( mDropoutFillEnabled && mPoseDatabase && mPoseDatabase->getNumFrames() > 0 &&
+				  now - mLastPoseTime > mDropoutTimeout * 0.001 && mPose.mFrameId >= 0 )
+		{
+			updateDropoutFill( now );
+		}
+		mClusterLag = 0.0f;
+	}
+
+	// after the pose and before the skinning
+	if ( mGroundingEnabled )
+	{
+		mFootGrounding->apply( mAvatar, getElapsedSeconds() );
+	}
+
 	mAvatar->update();
+	mMotionTrails->addFrame( mAvatar );
+	mLatencyStats->markUpdated();
+
+	updateLatencyStats();
+
+	if ( mVideoRecorder )
+	{
+		mRecordedFrames = mVideoRecorder->getEncodedFrames();
+		mDroppedVideoFrames = mVideoRecorder->getDroppedFrames();
+	}
+	mFinishingRecorders.erase( std::remove_if( mFinishingRecorders.begin(), mFinishingRecorders.end(),
+			[]( const VideoRecorderRef &recorder ) { return recorder->isFinished(); } ),
+			mFinishingRecorders.end() );
+}
+
+void AIamRendererApp::applyPose()
+{
+	if ( mRecordingPoses && mPose.mOrientationMask.all() )
+	{
+		mPoseSessionWriter->addPose( mPose );
+	}
+
+	if ( mFilterEnabled )
+	{
+		mPoseFilter->filter( &mPose, getElapsedSeconds() );
+	}
+	mAvatar->setPose( mPose );
+	mLatencyStats->markApplied( mPose.mFrameId );
+}
+
+void AIamRendererApp::updateDropoutFill( double time )
+{
+	if ( mFillFrame == PoseDatabase::npos )
+	{
+		// the dropout starts, continue from the recorded frame closest to the last pose
+		mFillFrame = mPoseDatabase->findNearest( mPose );
+		mHeldPose = mPose;
+		mFillStartTime = time;
+		mFillFrameTime = time;
+	}
+	else
+	{
+		// play the continuation at its recorded rate, the end of the session is held
+		double period = 1.0 / mPoseDatabase->getRate( mFillFrame );
+		while ( time - mFillFrameTime >= period )
+		{
+			size_t next = mPoseDatabase->getNextFrame( mFillFrame );
+			if ( next == PoseDatabase::npos )
+			{
+				mFillFrameTime = time;
+				break;
+			}
+			mFillFrame = next;
+			mFillFrameTime += period;
+		}
+	}
+
+	mFillPose.clear();
+	mPoseDatabase->getPose( mFillFrame, &mFillPose );
+	float t = mDropoutBlendTime > 0.0f ?
+			  math< float >::min( static_cast< float >( time - mFillStartTime ) / mDropoutBlendTime, 1.0f ) : 1.0f;
+	for ( size_t i = 0; i < Avatar::TOTAL_JOINTS; i++ )
+	{
+		if ( ! mHeldPose.mOrientationMask[ i ] )
+		{
+			continue;
+		}
+		const Quatf &a = mHeldPose.mOrientations[ i ];
+		Quatf b = mFillPose.mOrientations[ i ];
+		if ( a.dot( b ) < 0.0f )
+		{
+			b = -b;
+		}
+		mFillPose.mOrientations[ i ] = ( a * ( 1.0f - t ) + b * t ).normalized();
+	}
+	// the root stays where the stream left it
+	mFillPose.mPositionMask = mHeldPose.mPositionMask;
+	std::copy( mHeldPose.mPositions, mHeldPose.mPositions + Avatar::TOTAL_JOINTS, mFillPose.mPositions );
+
+	mAvatar->setPose( mFillPose );
+}
+
+PoseDatabaseRef AIamRendererApp::loadPoseDatabase()
+{
+	PoseDatabaseRef database = PoseDatabase::create();
+
+	fs::path posesPath = getAssetPath( "poses" );
+	if ( ! posesPath.empty() )
+	{
+		for ( fs::directory_iterator it( posesPath ); it != fs::directory_iterator(); ++it )
+		{
+			if ( it->path().extension() == ".poses" )
+			{
+				database->addSession( loadFile( it->path() ) );
+			}
+		}
+	}
+	database->buildIndex();
+	return database;
+}
+
+void AIamRendererApp::startPoseRecording()
+{
+	// the session is part of the database from the next start
+	fs::path posesPath = app::getAssetPath( "" ) / "poses";
+	fs::create_directories( posesPath );
+	mPoseSessionPath = posesPath / ( "session-" + toString( std::time( nullptr ) ) + ".poses" );
+	mPoseSessionWriter = std::make_shared< PoseDatabase::SessionWriter >( mPoseSessionPath );
+	if ( ! mPoseSessionWriter->isOpen() )
+	{
+		app::console() << "Error: cannot write pose session " << mPoseSessionPath << std::endl;
+		mPoseSessionWriter.reset();
+		return;
+	}
+
+	mPoseRecordingStartTime = getElapsedSeconds();
+	mRecordingPoses = true;
+}
+
+void AIamRendererApp::stopPoseRecording()
+{
+	if ( ! mPoseSessionWriter )
+	{
+		return;
+	}
+
+	mRecordingPoses = false;
+	double duration = getElapsedSeconds() - mPoseRecordingStartTime;
+	size_t numFrames = mPoseSessionWriter->getNumFrames();
+	float rate = duration > 0.0 ? static_cast< float >( numFrames / duration ) : 0.0f;
+	if ( ! mPoseSessionWriter->close( rate ) )
+	{
+		app::console() << "Error: cannot write pose session " << mPoseSessionPath << std::endl;
+	}
+	mPoseSessionWriter.reset();
+
+	if ( numFrames == 0 )
+	{
+		fs::remove( mPoseSessionPath );
+	}
+}
+
+void AIamRendererApp::updateLatencyStats()
+{
+	for ( int i = 0; i < LatencyStats::NUM_STAGES; i++ )
+	{
+		mLatencyStageMeans[ i ] = mLatencyStats->getHistogram( LatencyStats::Stage( i ) ).getMean();
+	}
+	const LatencyStats::Histogram &total = mLatencyStats->getHistogram( LatencyStats::TOTAL );
+	mLatencyTotalP95 = total.getPercentile( 95.0 );
+	mLatencyTotalP99 = total.getPercentile( 99.0 );
+	mLatencySupersededFrames = mLatencyStats->getSupersededFrames();
+	mDroppedPoseMessages = mPoseBuffer->getDroppedMessages();
+	mIncompletePoseFrames = mPoseBuffer->getIncompleteFrames();
+
+	if ( mStatsExportInterval <= 0.0f )
+	{
+		return;
+	}
+
+	double now = getElapsedSeconds();
+	if ( now - mLastStatsExportTime < mStatsExportInterval )
+	{
+		return;
+	}
+	mLastStatsExportTime = now;
+
+	if ( ! mStatsFile.is_open() )
+	{
+		fs::path statsPath = app::getAssetPath( "" ) / "latency.csv";
+		bool exists = fs::exists( statsPath );
+		mStatsFile.open( statsPath.string().c_str(), std::ios::app );
+		if ( ! exists )
+		{
+			mLatencyStats->writeCsvHeader( mStatsFile );
+		}
+	}
+	mLatencyStats->writeCsvRow( mStatsFile );
 }
 
 void AIamRendererApp::draw()
 {
-	gl::setViewport( getWindowBounds() );
+	// the scene renders at the dynamic resolution, the params at the window resolution
+	mDynamicResolution->bind( getWindowSize() );
 	gl::setMatrices( mCamera );
 	gl::clear();
 
@@ -208,13 +934,16 @@ void AIamRendererApp::draw()
 	{
 		gl::enableWireframe();
 	}
-	mAvatar->draw();
+	if ( mAvatar )
+	{
+		mAvatar->draw();
+	}
 	if ( mEnableWireframe )
 	{
 		gl::disableWireframe();
 	}
 
-	if ( mDrawPlane )
+	if ( mDrawPlane && mTriMeshPlane.getNumVertices() > 0 )
 	{
 		gl::pushModelView();
 		gl::color( Color::gray( 0.1f ) );
@@ -232,7 +961,39 @@ void AIamRendererApp::draw()
 		gl::popModelView();
 	}
 
-	mParams->draw();
+	// the history is transparent, drawn over the opaque scene
+	mMotionTrails->drawGhosts( mGhostCount, mGhostSpacing, mGhostColor );
+	if ( mDrawTrails )
+	{
+		mMotionTrails->drawTrails( mTrailJoints, mTrailLength, mTrailWidth, mTrailColor );
+	}
+
+	mDynamicResolution->unbind();
+	mDynamicResolution->draw( getWindowBounds() );
+	mResolutionScale = mDynamicResolution->getScale();
+	mSceneGpuTime = mDynamicResolution->getGpuTime();
+
+	// the recording does not contain the params
+	if ( mVideoRecorder )
+	{
+		mVideoRecorder->captureFrame( getElapsedSeconds() - mRecordingStartTime );
+	}
+
+	mParamsOverlay->draw();
+
+	if ( ! mStartup->isDone() )
+	{
+		gl::setMatricesWindow( getWindowSize() );
+		gl::drawString( "Loading " + mStartup->getStatus(),
+						Vec2f( 16.0f, getWindowHeight() - 32.0f ) );
+	}
+
+	mLatencyStats->markDrawn();
+	mFrameScheduler->endFrame( mSceneGpuTime );
+	mPredictedFrameCost = mFrameScheduler->getPredictedCost();
+
+	// swap barrier of the cluster
+	mClusterSync->waitForDeadline( mPose.mFrameId );
 }
 
 bool AIamRendererApp::orientationReceived( const mndl::osc::Message &message )
@@ -240,13 +1001,15 @@ bool AIamRendererApp::orientationReceived( const mndl::osc::Message &message )
 	//app::console() << message << std::endl;
 	int frameId = message.getArg< int >( 0 );
 	int jointId = message.getArg< int >( 1 );
+	double senderTime = message.getNumArgs() > 5 ? message.getArg< double >( 5 ) : 0.0;
+	mLatencyStats->markReceived( frameId, senderTime );
 
 	Vec3f eulerAngles;
 	eulerAngles.x = message.getArg< float >( 2 );
 	eulerAngles.y = message.getArg< float >( 3 );
 	eulerAngles.z = message.getArg< float >( 4 );
 
-	mAvatar->setOrientation( frameId, jointId, eulerAngles );
+	mPoseBuffer->setOrientation( frameId, jointId, eulerAngles );
 	return false;
 }
 
@@ -255,17 +1018,33 @@ bool AIamRendererApp::translationReceived( const mndl::osc::Message &message )
 	//app::console() << message << std::endl;
 	int frameId = message.getArg< int >( 0 );
 	int jointId = message.getArg< int >( 1 );
+	double senderTime = message.getNumArgs() > 5 ? message.getArg< double >( 5 ) : 0.0;
+	mLatencyStats->markReceived( frameId, senderTime );
 
 	Vec3f p;
 	p.x = message.getArg< float >( 2 );
 	p.y = message.getArg< float >( 3 );
 	p.z = message.getArg< float >( 4 );
 
-	mAvatar->setPosition( frameId, jointId, p );
+	mPoseBuffer->setPosition( frameId, jointId, p );
 
 	return false;
 }
 
+bool AIamRendererApp::poseReceived( const mndl::osc::Message &message )
+{
+	Buffer blob = message.getArg< Buffer >( 0 );
+	if ( ! mPoseDecoder->decode( static_cast< const uint8_t * >( blob.getData() ), blob.getDataSize(), &mDecodedPose ) )
+	{
+		return false;
+	}
+
+	double senderTime = message.getNumArgs() > 1 ? message.getArg< double >( 1 ) : 0.0;
+	mLatencyStats->markReceived( mDecodedPose.mFrameId, senderTime );
+	mPoseBuffer->setPose( mDecodedPose );
+	return false;
+}
+
 // based on Cinder-MeshHelper by Ban the Rewind
 // https://github.com/BanTheRewind/Cinder-MeshHelper/
 TriMesh AIamRendererApp::createSquare( const Vec2i &resolution )
@@ -365,6 +1144,35 @@ void AIamRendererApp::createGrid()
 }
 
 
+void AIamRendererApp::startRecording()
+{
+	fs::path moviePath = app::getAssetPath( "" ) /
+		( "recording-" + toString( std::time( nullptr ) ) + ".mp4" );
+	VideoRecorder::Format format;
+	format.mFps = mRecordingFps;
+	format.mCrf = mRecordingCrf;
+	mVideoRecorder = VideoRecorder::create( moviePath, getWindowWidth(), getWindowHeight(), format );
+	if ( ! mVideoRecorder->isOpen() )
+	{
+		mVideoRecorder.reset();
+		return;
+	}
+	mRecordingStartTime = getElapsedSeconds();
+	mRecording = true;
+}
+
+void AIamRendererApp::stopRecording()
+{
+	// the encoder flushes in the background, the recorder is released in update() when it is done
+	if ( mVideoRecorder )
+	{
+		mVideoRecorder->finish();
+		mFinishingRecorders.push_back( mVideoRecorder );
+		mVideoRecorder.reset();
+	}
+	mRecording = false;
+}
+
 void AIamRendererApp::mouseDown( MouseEvent event )
 {
 	mMayaCam.setCurrentCam( mCamera );
@@ -389,6 +1197,9 @@ void AIamRendererApp::mouseDrag( MouseEvent event )
 
 void AIamRendererApp::resize()
 {
+	// the recording has a fixed frame size
+	stopRecording();
+
 	mCamera.setAspectRatio( getWindowAspectRatio() );
 	mMayaCam.setCurrentCam( mCamera );
 }
@@ -433,6 +1244,17 @@ void AIamRendererApp::keyDown( KeyEvent event )
 			}
 			break;
 
+		case KeyEvent::KEY_r:
+			if ( mVideoRecorder )
+			{
+				stopRecording();
+			}
+			else
+			{
+				startRecording();
+			}
+			break;
+
 		case KeyEvent::KEY_ESCAPE:
 			quit();
 			break;
@@ -444,8 +1266,18 @@ void AIamRendererApp::keyDown( KeyEvent event )
 
 void AIamRendererApp::shutdown()
 {
-	mListener.unregisterOscReceived( translationHandlerId );
-	mListener.unregisterOscReceived( orientationHandlerId );
+	// waits for the loading workers
+	mStartup.reset();
+	stopRecording();
+	// waits for the encoders to close the files
+	mFinishingRecorders.clear();
+	stopPoseRecording();
+	mClusterSync.reset();
+
+	for ( uint32_t handlerId : mOscHandlerIds )
+	{
+		mListener.unregisterOscReceived( handlerId );
+	}
 
 	fs::path configPath = app::getAssetPath( "" ) / "config.xml";
 	mndl::params::writeParamsLayout();
@@ -1,29 +1,233 @@
+#include <algorithm>
+
 #include "cinder/app/App.h"
 
+#include "assimp/cimport.h"
+#include "assimp/postprocess.h"
+#include "assimp/scene.h"
+
 #include "Avatar.h"
+#include "Pose.h"
 
 using namespace ci;
 
-Avatar::Avatar( const fs::path &modelPath )
+// the products are written out, ci::Quatf multiplies in the reverse order of the usual notation
+static Quatf conjugateTimes( const Quatf &a, const Quatf &b )
+{
+	// conjugate( a ) * b
+	Vec3f v = a.w * b.v - b.w * a.v - a.v.cross( b.v );
+	return Quatf( a.w * b.w + a.v.dot( b.v ), v.x, v.y, v.z );
+}
+
+static Vec3f inverseRotate( const Quatf &q, const Vec3f &v )
+{
+	// conjugate( q ) * v * q
+	Vec3f t = 2.0f * v.cross( q.v );
+	return v + q.w * t + t.cross( q.v );
+}
+
+Avatar::Avatar( const fs::path &modelPath, const RetargetMapRef &retargetMap )
 {
 	mAssimpLoader = mndl::assimp::AssimpLoader::create( modelPath );
 	mAssimpLoader->enableSkinning();
 
-	collectJoints();
+	collectJoints( retargetMap ? retargetMap : RetargetMap::createDefault() );
 }
 
-void Avatar::collectJoints()
+bool Avatar::hasTextures( const fs::path &modelPath )
 {
-	for ( size_t i = 0; i < Joints::TOTAL_JOINTS; i++ )
+	// without post processing the import only parses the file
+	const aiScene *scene = aiImportFile( modelPath.string().c_str(), 0 );
+	if ( ! scene )
+	{
+		// the import on the gl thread reports the error
+		return true;
+	}
+
+	bool textured = false;
+	for ( unsigned i = 0; i < scene->mNumMaterials && ! textured; i++ )
 	{
-		const std::string &jointName = sJointNames[ i ];
-		auto node = mAssimpLoader->getAssimpNode( jointName );
-		mJoints[ i ] = node;
+		textured = scene->mMaterials[ i ]->GetTextureCount( aiTextureType_DIFFUSE ) > 0;
+	}
+	aiReleaseImport( scene );
+	return textured;
+}
+
+static Matrix44f toTransform( const Vec3f &position, const Quatf &orientation, const Vec3f &scale = Vec3f::one() )
+{
+	return Matrix44f::createTranslation( position ) * orientation.toMatrix44() * Matrix44f::createScale( scale );
+}
+
+bool Avatar::getSkin( const fs::path &modelPath, Skin *skin ) const
+{
+	skin->mVertices.clear();
+	skin->mIndices.clear();
+	skin->mBones.clear();
+
+	// the loader keeps its scene to itself, the meshes are imported again for their bones
+	const aiScene *scene = aiImportFile( modelPath.string().c_str(),
+			aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_LimitBoneWeights );
+	if ( ! scene )
+	{
+		app::console() << "Warning: skin import failed " << modelPath.string() << ": " << aiGetErrorString() << std::endl;
+		return false;
+	}
+
+	for ( unsigned m = 0; m < scene->mNumMeshes; m++ )
+	{
+		const aiMesh *mesh = scene->mMeshes[ m ];
+		if ( ! mesh->HasBones() )
+		{
+			continue;
+		}
+
+		size_t base = skin->mVertices.size();
+		skin->mVertices.resize( base + mesh->mNumVertices );
+		for ( unsigned v = 0; v < mesh->mNumVertices; v++ )
+		{
+			Skin::Vertex &vertex = skin->mVertices[ base + v ];
+			vertex.mPosition = Vec3f( mesh->mVertices[ v ].x, mesh->mVertices[ v ].y, mesh->mVertices[ v ].z );
+			std::fill( vertex.mBones, vertex.mBones + 4, 0.0f );
+			std::fill( vertex.mWeights, vertex.mWeights + 4, 0.0f );
+		}
+
+		for ( unsigned b = 0; b < mesh->mNumBones; b++ )
+		{
+			const aiBone *bone = mesh->mBones[ b ];
+			float boneId = static_cast< float >( skin->mBones.size() / 4 );
+
+			// the nodes between the bone and its joint are not posed, so the bind matrix is constant
+			auto node = mAssimpLoader->getAssimpNode( bone->mName.data );
+			size_t joint = Joints::TOTAL_JOINTS;
+			for ( auto n = node; n && joint == Joints::TOTAL_JOINTS; n = n->getParent() )
+			{
+				for ( size_t j = 0; j < Joints::TOTAL_JOINTS; j++ )
+				{
+					if ( mJoints[ j ] && mJoints[ j ] == n )
+					{
+						joint = j;
+						break;
+					}
+				}
+			}
+
+			const aiMatrix4x4 &o = bone->mOffsetMatrix;
+			Matrix44f offset( o.a1, o.b1, o.c1, o.d1, o.a2, o.b2, o.c2, o.d2,
+							  o.a3, o.b3, o.c3, o.d3, o.a4, o.b4, o.c4, o.d4 );
+			Matrix44f nodeWorld = node ? toTransform( node->getDerivedPosition(), node->getDerivedOrientation(),
+													  node->getDerivedScale() ) : Matrix44f::identity();
+			Matrix44f jointWorld = joint < Joints::TOTAL_JOINTS ?
+								   toTransform( mJoints[ joint ]->getDerivedPosition(), mJoints[ joint ]->getDerivedOrientation() ) :
+								   Matrix44f::identity();
+			Matrix44f bind = jointWorld.inverted() * nodeWorld * offset;
+			for ( int row = 0; row < 3; row++ )
+			{
+				skin->mBones.push_back( Vec4f( bind.at( row, 0 ), bind.at( row, 1 ), bind.at( row, 2 ), bind.at( row, 3 ) ) );
+			}
+			skin->mBones.push_back( Vec4f( joint < Joints::TOTAL_JOINTS ? static_cast< float >( joint ) : -1.0f,
+										   0.0f, 0.0f, 0.0f ) );
+
+			for ( unsigned w = 0; w < bone->mNumWeights; w++ )
+			{
+				// the lightest of the four slots, at most four weights are left per vertex
+				Skin::Vertex &vertex = skin->mVertices[ base + bone->mWeights[ w ].mVertexId ];
+				float *slot = std::min_element( vertex.mWeights, vertex.mWeights + 4 );
+				if ( *slot < bone->mWeights[ w ].mWeight )
+				{
+					*slot = bone->mWeights[ w ].mWeight;
+					vertex.mBones[ slot - vertex.mWeights ] = boneId;
+				}
+			}
+		}
+
+		for ( unsigned f = 0; f < mesh->mNumFaces; f++ )
+		{
+			const aiFace &face = mesh->mFaces[ f ];
+			if ( face.mNumIndices == 3 )
+			{
+				for ( unsigned i = 0; i < 3; i++ )
+				{
+					skin->mIndices.push_back( static_cast< uint32_t >( base + face.mIndices[ i ] ) );
+				}
+			}
+		}
+	}
+	aiReleaseImport( scene );
+
+	for ( Skin::Vertex &vertex : skin->mVertices )
+	{
+		float sum = vertex.mWeights[ 0 ] + vertex.mWeights[ 1 ] + vertex.mWeights[ 2 ] + vertex.mWeights[ 3 ];
+		if ( sum > 0.0f )
+		{
+			for ( float &weight : vertex.mWeights )
+			{
+				weight /= sum;
+			}
+		}
+	}
+	return true;
+}
+
+void Avatar::collectJoints( const RetargetMapRef &retargetMap )
+{
+	mTargets.clear();
+	for ( const auto &entry : retargetMap->getEntries() )
+	{
+		auto node = mAssimpLoader->getAssimpNode( entry.mTargetName );
 		if ( ! node )
 		{
-			app::console() << "Warning: joint not found for name " << jointName << std::endl;
+			app::console() << "Warning: joint not found for name " << entry.mTargetName << std::endl;
+			continue;
+		}
+
+		JointTarget target;
+		target.mEntry = entry;
+		target.mNode = node;
+		if ( entry.mBindOffsets )
+		{
+			// the rotations go on top of the bind pose, the local orientation is
+			// parent^-1 q bind in the usual notation, post q pre in ci::Quatf order
+			auto parent = node->getParent();
+			target.mEntry.mPreOffset = node->getDerivedOrientation();
+			target.mEntry.mPostOffset = parent ? parent->getDerivedOrientation().inverse() : Quatf();
+		}
+		mTargets.push_back( target );
+
+		if ( ! mJoints[ entry.mSourceId ] )
+		{
+			mJoints[ entry.mSourceId ] = node;
+		}
+	}
+
+	// index the targets by source joint, a joint may drive several nodes in map order
+	std::stable_sort( mTargets.begin(), mTargets.end(),
+					  []( const JointTarget &a, const JointTarget &b ) { return a.mEntry.mSourceId < b.mEntry.mSourceId; } );
+	size_t t = 0;
+	for ( size_t i = 0; i <= Joints::TOTAL_JOINTS; i++ )
+	{
+		while ( t < mTargets.size() && mTargets[ t ].mEntry.mSourceId < i )
+		{
+			t++;
+		}
+		mTargetBegin[ i ] = t;
+	}
+
+	if ( mJoints[ HIP ] )
+	{
+		mRootPosition = mJoints[ HIP ]->getPosition();
+	}
+}
+
+size_t Avatar::findJointId( const std::string &name )
+{
+	for ( size_t i = 0; i < Joints::TOTAL_JOINTS; i++ )
+	{
+		if ( sJointNames[ i ] == name )
+		{
+			return i;
 		}
 	}
+	return Joints::TOTAL_JOINTS;
 }
 
 void Avatar::update()
@@ -36,6 +240,58 @@ void Avatar::draw()
 	mAssimpLoader->draw();
 }
 
+void Avatar::getJointTransforms( Vec3f *positions, Quatf *orientations ) const
+{
+	for ( size_t i = 0; i < Joints::TOTAL_JOINTS; i++ )
+	{
+		if ( mJoints[ i ] )
+		{
+			positions[ i ] = mJoints[ i ]->getDerivedPosition();
+			orientations[ i ] = mJoints[ i ]->getDerivedOrientation();
+		}
+	}
+}
+
+void Avatar::setJointWorldOrientation( size_t jointId, const Quatf &orientation )
+{
+	const auto &node = mJoints[ jointId ];
+	if ( ! node )
+	{
+		return;
+	}
+
+	auto parent = node->getParent();
+	node->setOrientation( parent ? conjugateTimes( parent->getDerivedOrientation(), orientation ) : orientation );
+}
+
+void Avatar::setRootOffset( const Vec3f &offset )
+{
+	mRootOffset = offset;
+	applyRootOffset();
+}
+
+void Avatar::applyRootOffset()
+{
+	const auto &node = mJoints[ HIP ];
+	if ( ! node )
+	{
+		return;
+	}
+
+	Vec3f localOffset = mRootOffset;
+	auto parent = node->getParent();
+	if ( parent )
+	{
+		localOffset = inverseRotate( parent->getDerivedOrientation(), mRootOffset ) / parent->getDerivedScale();
+	}
+	node->setPosition( mRootPosition + localOffset );
+}
+
+void Avatar::enableSkinning( bool enable /* = true */ )
+{
+	mAssimpLoader->enableSkinning( enable );
+}
+
 void Avatar::setPosition( size_t frameId, size_t jointId, const Vec3f &position )
 {
 	if ( jointId >= Joints::TOTAL_JOINTS )
@@ -43,10 +299,16 @@ void Avatar::setPosition( size_t frameId, size_t jointId, const Vec3f &position
 		return;
 	}
 
-	auto node = mJoints[ jointId ];
-	if ( node )
+	for ( size_t t = mTargetBegin[ jointId ]; t < mTargetBegin[ jointId + 1 ]; t++ )
 	{
-		node->setPosition( position );
+		const JointTarget &target = mTargets[ t ];
+		target.mNode->setPosition( position * target.mEntry.mPositionScale );
+	}
+
+	if ( jointId == HIP && mJoints[ HIP ] )
+	{
+		mRootPosition = mJoints[ HIP ]->getPosition();
+		applyRootOffset();
 	}
 }
 
@@ -56,19 +318,46 @@ void Avatar::setOrientation( size_t frameId, size_t jointId, const ci::Vec3f &eu
 	{
 		return;
 	}
-	auto node = mJoints[ jointId ];
-	if ( ! node )
+
+	Quatf q = eulerToQuat( eulerDegrees );
+	for ( size_t t = mTargetBegin[ jointId ]; t < mTargetBegin[ jointId + 1 ]; t++ )
 	{
-		return;
+		const JointTarget &target = mTargets[ t ];
+		target.mNode->setOrientation( target.mEntry.mPreOffset * q * target.mEntry.mPostOffset );
 	}
+}
 
+void Avatar::setPose( const Pose &pose )
+{
+	for ( const auto &target : mTargets )
+	{
+		const RetargetMap::Entry &entry = target.mEntry;
+		size_t i = entry.mSourceId;
+		if ( pose.mPositionMask[ i ] )
+		{
+			target.mNode->setPosition( pose.mPositions[ i ] * entry.mPositionScale );
+		}
+		if ( pose.mOrientationMask[ i ] )
+		{
+			target.mNode->setOrientation( entry.mPreOffset * pose.mOrientations[ i ] * entry.mPostOffset );
+		}
+	}
+
+	if ( pose.mPositionMask[ HIP ] && mJoints[ HIP ] )
+	{
+		mRootPosition = mJoints[ HIP ]->getPosition();
+		applyRootOffset();
+	}
+}
+
+Quatf Avatar::eulerToQuat( const Vec3f &eulerDegrees )
+{
 	// BVH rotation order is ZXY
 	Matrix33f rotation = Matrix33f::createRotation( Vec3f::zAxis(), toRadians( eulerDegrees.z ) );
 	rotation.rotate( Vec3f::xAxis(), toRadians( eulerDegrees.x ) );
 	rotation.rotate( Vec3f::yAxis(), toRadians( eulerDegrees.y ) );
 
-	Quatf quat( rotation );
-	node->setOrientation( quat );
+	return Quatf( rotation );
 }
 
 std::string Avatar::sJointNames[ Joints::TOTAL_JOINTS ] =
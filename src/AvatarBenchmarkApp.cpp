@@ -0,0 +1,895 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cinder/Buffer.h"
+#include "cinder/Camera.h"
+#include "cinder/Cinder.h"
+#include "cinder/DataSource.h"
+#include "cinder/Json.h"
+#include "cinder/Timer.h"
+#include "cinder/app/App.h"
+#include "cinder/app/AppNative.h"
+#include "cinder/gl/Fbo.h"
+#include "cinder/gl/gl.h"
+
+#include "Avatar.h"
+#include "FootGrounding.h"
+#include "PoseBuffer.h"
+#include "PoseCodec.h"
+#include "PoseDatabase.h"
+#include "PoseGenerator.h"
+#include "RetargetMap.h"
+
+using namespace ci;
+using namespace ci::app;
+
+/*
+ Drives the avatar with synthetic poses and measures the pose apply,
+ skeleton update, skinning and offscreen draw times per frame.
+
+ Options, all optional:
+	--frames=N          measured frames per phase (default 1000)
+	--warmup=N          frames before measuring (default 100)
+	--rate=R            pose rate in Hz (default 30)
+	--noise=D           pose noise in degrees (default 1)
+	--seed=S            pose generator seed (default 0)
+	--output=PATH       results json (default benchmark.json in the assets folder)
+	--baseline=PATH     baseline json to compare with (default benchmark-baseline.json in the assets folder)
+	--tolerance=PCT     allowed slowdown against the baseline in percent (default 10),
+	                    a slower metric fails the benchmark
+	--update-baseline   writes the results to the baseline path as well
+	--senders=N         concurrent sender threads feeding the poses through a PoseBuffer
+	                    while the avatar is updated and drawn (default 0, direct apply)
+	--sender-rate=R     poses per second per sender thread, 0 is unthrottled (default 0)
+	--database-frames=N generated frames of a pose database to time the nearest pose
+	                    search with (default 0, no database)
+	--database-target   times the search at the target database size of 2000000 frames as well
+	--database-max-visits=N visit budget of the timed searches (default 500, as the renderer)
+	--grounding-avatars=N avatars to time the foot grounding and its solver with (default 0, no grounding)
+
+ With senders the joints of the avatar are checked against the generator
+ after every pose taken from the buffer, joints of other frames are
+ reported as coherence errors. Build with 'scons benchmark=1 tsan=1' to run
+ it under ThreadSanitizer. The benchmark exits with a nonzero status when a
+ check fails.
+
+ The generated poses are also sent through the compact wire format with
+ some delta frames lost, the largest orientation error against
+ Avatar::eulerToQuat and the encoded sizes are reported under "codec".
+
+ A retarget map with offsets from the bind pose is checked under
+ "retarget": a rotation of a single joint has to turn its node in world
+ space on top of the bind pose.
+*/
+class AvatarBenchmarkApp : public AppNative
+{
+ public:
+	void prepareSettings( Settings *settings );
+	void setup();
+	void shutdown();
+
+	void update();
+	void draw();
+
+ private:
+	void parseArgs();
+	void runFrame();
+	void writeResults();
+
+	void startSenders();
+	void stopSenders();
+	void sendPoses( uint32_t senderId );
+	//! Checks that every joint of the avatar has the value of frame \a frameId.
+	void checkPose( int32_t frameId );
+	JsonTree checkCodec();
+	JsonTree checkRetarget();
+	JsonTree checkDatabase( const std::string &name, int numFrames );
+	JsonTree checkGrounding();
+
+	struct Samples
+	{
+		std::vector< double > mValues;
+
+		void add( double ms ) { mValues.push_back( ms ); }
+		double getMean() const;
+		double getPercentile( double p ) const;
+		double getMin() const;
+	};
+
+	JsonTree samplesToJson( const std::string &name, const Samples &samples ) const;
+
+	enum Phase
+	{
+		WARMUP = 0,
+		SKELETON,
+		FULL,
+		DONE
+	};
+
+	Phase mPhase = WARMUP;
+	int mPhaseFrame = 0;
+
+	int mFrames = 1000;
+	int mWarmupFrames = 100;
+	float mRate = 30.0f;
+	float mNoise = 1.0f;
+	uint32_t mSeed = 0;
+	float mTolerance = 10.0f;
+	fs::path mOutputPath;
+	fs::path mBaselinePath;
+	bool mUpdateBaseline = false;
+
+	AvatarRef mAvatar;
+	PoseGeneratorRef mPoseGenerator;
+
+	int mSenders = 0;
+	float mSenderRate = 0.0f;
+	int mDatabaseFrames = 0;
+	bool mDatabaseTarget = false;
+	int mDatabaseMaxVisits = PoseDatabase::DEFAULT_MAX_VISITS;
+	static const int TARGET_DATABASE_FRAMES = 2000000;
+	int mGroundingAvatars = 0;
+	PoseBufferRef mPoseBuffer;
+	Pose mPose;
+	bool mNewPose = false;
+	std::vector< std::thread > mSenderThreads;
+	std::atomic< bool > mSendersRunning { false };
+	std::atomic< int32_t > mNextSenderFrameId { 0 };
+	std::atomic< uint32_t > mInvalidMessagesSent { 0 };
+
+	PoseGeneratorRef mVerifyGenerator;
+	uint32_t mPosesReceived = 0;
+	uint32_t mCoherenceErrors = 0;
+	// any failed check, the benchmark then exits with a nonzero status
+	bool mFailed = false;
+
+	gl::Fbo mFbo;
+	CameraPersp mCamera;
+
+	Samples mApplySamples;
+	Samples mSkeletonSamples;
+	Samples mSkinnedUpdateSamples;
+	Samples mDrawSamples;
+	Samples mFrameSamples;
+};
+
+void AvatarBenchmarkApp::prepareSettings( Settings *settings )
+{
+	settings->setWindowSize( 320, 180 );
+	settings->disableFrameRate();
+}
+
+void AvatarBenchmarkApp::setup()
+{
+	mOutputPath = getAssetPath( "" ) / "benchmark.json";
+	mBaselinePath = getAssetPath( "" ) / "benchmark-baseline.json";
+	parseArgs();
+
+	gl::enableVerticalSync( false );
+
+	mAvatar = Avatar::create( getAssetPath( "model/avatar.dae" ) );
+	mPoseGenerator = PoseGenerator::create( mSeed );
+	mPoseGenerator->setRate( mRate );
+	mPoseGenerator->setNoise( mNoise );
+
+	gl::Fbo::Format format;
+	format.enableDepthBuffer();
+	mFbo = gl::Fbo( 1152, 648, format );
+
+	mCamera.setPerspective( 45.0f, mFbo.getAspectRatio(), 0.1f, 10000.0f );
+	mCamera.lookAt( Vec3f( 0.0f, 0.0f, 500.0f ), Vec3f::zero() );
+
+	if ( mSenders > 0 )
+	{
+		startSenders();
+	}
+}
+
+void AvatarBenchmarkApp::shutdown()
+{
+	stopSenders();
+
+	if ( mFailed )
+	{
+		console() << "Benchmark failed" << std::endl;
+		std::exit( EXIT_FAILURE );
+	}
+}
+
+void AvatarBenchmarkApp::parseArgs()
+{
+	for ( const std::string &arg : getArgs() )
+	{
+		if ( arg.compare( 0, 2, "--" ) != 0 )
+		{
+			continue;
+		}
+
+		size_t eq = arg.find( '=' );
+		std::string key = arg.substr( 2, eq == std::string::npos ? std::string::npos : eq - 2 );
+		std::string value = eq == std::string::npos ? "" : arg.substr( eq + 1 );
+
+		if ( key == "frames" )
+			mFrames = std::max( fromString< int >( value ), 1 );
+		else if ( key == "warmup" )
+			mWarmupFrames = std::max( fromString< int >( value ), 0 );
+		else if ( key == "rate" )
+			mRate = std::max( fromString< float >( value ), 1.0f );
+		else if ( key == "noise" )
+			mNoise = fromString< float >( value );
+		else if ( key == "seed" )
+			mSeed = fromString< uint32_t >( value );
+		else if ( key == "output" )
+			mOutputPath = value;
+		else if ( key == "baseline" )
+			mBaselinePath = value;
+		else if ( key == "tolerance" )
+			mTolerance = fromString< float >( value );
+		else if ( key == "update-baseline" )
+			mUpdateBaseline = true;
+		else if ( key == "senders" )
+			mSenders = std::max( fromString< int >( value ), 0 );
+		else if ( key == "sender-rate" )
+			mSenderRate = std::max( fromString< float >( value ), 0.0f );
+		else if ( key == "database-frames" )
+			mDatabaseFrames = std::max( fromString< int >( value ), 0 );
+		else if ( key == "database-target" )
+			mDatabaseTarget = true;
+		else if ( key == "database-max-visits" )
+			mDatabaseMaxVisits = std::max( fromString< int >( value ), 0 );
+		else if ( key == "grounding-avatars" )
+			mGroundingAvatars = std::max( fromString< int >( value ), 0 );
+		else
+			console() << "Warning: unknown option " << arg << std::endl;
+	}
+}
+
+void AvatarBenchmarkApp::update()
+{
+	if ( mPhase == DONE )
+	{
+		return;
+	}
+
+	runFrame();
+	if ( mNewPose )
+	{
+		checkPose( mPose.mFrameId );
+		mNewPose = false;
+	}
+
+	mPhaseFrame++;
+	int phaseLength = ( mPhase == WARMUP ) ? mWarmupFrames : mFrames;
+	if ( mPhaseFrame >= phaseLength )
+	{
+		mPhase = Phase( mPhase + 1 );
+		mPhaseFrame = 0;
+		// the skeleton phase measures the node updates without skinning
+		mAvatar->enableSkinning( mPhase != SKELETON );
+
+		if ( mPhase == DONE )
+		{
+			stopSenders();
+			writeResults();
+			quit();
+		}
+	}
+}
+
+void AvatarBenchmarkApp::runFrame()
+{
+	// both measured phases see the same pose sequence
+	mPoseGenerator->generate( mPhaseFrame );
+
+	Timer frameTimer( true );
+	Timer timer( true );
+	if ( mPoseBuffer )
+	{
+		mNewPose = mPoseBuffer->getLatestPose( &mPose );
+		if ( mNewPose )
+		{
+			mAvatar->setPose( mPose );
+		}
+	}
+	else
+	{
+		mPoseGenerator->apply( mAvatar );
+	}
+	double applyMs = timer.getSeconds() * 1000.0;
+
+	timer.start();
+	mAvatar->update();
+	double updateMs = timer.getSeconds() * 1000.0;
+
+	if ( mPhase == SKELETON )
+	{
+		mApplySamples.add( applyMs );
+		mSkeletonSamples.add( updateMs );
+		return;
+	}
+
+	timer.start();
+	mFbo.bindFramebuffer();
+	gl::setViewport( mFbo.getBounds() );
+	gl::setMatrices( mCamera );
+	gl::clear();
+	gl::enableDepthRead();
+	gl::enableDepthWrite();
+	mAvatar->draw();
+	mFbo.unbindFramebuffer();
+	glFinish();
+	double drawMs = timer.getSeconds() * 1000.0;
+
+	if ( mPhase == FULL )
+	{
+		mSkinnedUpdateSamples.add( updateMs );
+		mDrawSamples.add( drawMs );
+		mFrameSamples.add( frameTimer.getSeconds() * 1000.0 );
+	}
+}
+
+void AvatarBenchmarkApp::draw()
+{
+	gl::clear();
+	if ( mFbo )
+	{
+		gl::setMatricesWindow( getWindowSize() );
+		gl::setViewport( getWindowBounds() );
+		gl::draw( mFbo.getTexture(), getWindowBounds() );
+	}
+}
+
+void AvatarBenchmarkApp::startSenders()
+{
+	mPoseBuffer = PoseBuffer::create();
+	mVerifyGenerator = PoseGenerator::create( mSeed );
+	mVerifyGenerator->setRate( mRate );
+	mVerifyGenerator->setNoise( mNoise );
+
+	mSendersRunning = true;
+	for ( int i = 0; i < mSenders; i++ )
+	{
+		mSenderThreads.push_back( std::thread( &AvatarBenchmarkApp::sendPoses, this, i ) );
+	}
+}
+
+void AvatarBenchmarkApp::stopSenders()
+{
+	mSendersRunning = false;
+	for ( auto &t : mSenderThreads )
+	{
+		t.join();
+	}
+	mSenderThreads.clear();
+}
+
+void AvatarBenchmarkApp::sendPoses( uint32_t senderId )
+{
+	PoseGeneratorRef generator = PoseGenerator::create( mSeed );
+	generator->setRate( mRate );
+	generator->setNoise( mNoise );
+
+	auto next = std::chrono::steady_clock::now();
+	while ( mSendersRunning )
+	{
+		int32_t frameId = mNextSenderFrameId++;
+		generator->generate( frameId );
+
+		mPoseBuffer->setPosition( frameId, Avatar::HIP, generator->getRootPosition() );
+		for ( size_t i = 0; i < Avatar::TOTAL_JOINTS; i++ )
+		{
+			mPoseBuffer->setOrientation( frameId, i, generator->getEulerDegrees( i ) );
+			if ( i == senderId % Avatar::TOTAL_JOINTS )
+			{
+				// invalid joint ids have to be dropped
+				mPoseBuffer->setOrientation( frameId, Avatar::TOTAL_JOINTS + senderId, Vec3f::zero() );
+				mInvalidMessagesSent++;
+			}
+		}
+
+		if ( mSenderRate > 0.0f )
+		{
+			next += std::chrono::microseconds( static_cast< int64_t >( 1000000.0f / mSenderRate ) );
+			std::this_thread::sleep_until( next );
+		}
+	}
+}
+
+void AvatarBenchmarkApp::checkPose( int32_t frameId )
+{
+	mPosesReceived++;
+
+	// the nodes of the avatar, not the pose, the joints missing from a pose would keep older frames;
+	// the benchmark avatar has no retarget map, so the nodes take the joint values as they are
+	mVerifyGenerator->generate( frameId );
+	bool coherent = true;
+	for ( size_t i = 0; i < Avatar::TOTAL_JOINTS; i++ )
+	{
+		const mndl::assimp::AssimpNodeRef &node = mAvatar->getJointNode( i );
+		if ( ! node )
+		{
+			continue;
+		}
+
+		Quatf expected = Avatar::eulerToQuat( mVerifyGenerator->getEulerDegrees( i ) );
+		if ( math< float >::abs( expected.dot( node->getOrientation() ) ) < 0.9999f )
+		{
+			coherent = false;
+		}
+		if ( i == Avatar::HIP && node->getPosition().distance( mVerifyGenerator->getRootPosition() ) > 1e-4f )
+		{
+			coherent = false;
+		}
+	}
+
+	if ( ! coherent )
+	{
+		mCoherenceErrors++;
+		console() << "Error: avatar of frame " << frameId << " has joints of other frames" << std::endl;
+	}
+}
+
+JsonTree AvatarBenchmarkApp::checkCodec()
+{
+	// error bound of the 10 bit smallest three quaternions with some margin
+	const float maxAllowedError = 0.25f;
+
+	PoseGeneratorRef generator = PoseGenerator::create( mSeed );
+	generator->setRate( mRate );
+	generator->setNoise( mNoise );
+	PoseEncoderRef encoder = PoseEncoder::create();
+	PoseDecoderRef decoder = PoseDecoder::create();
+
+	Pose pose;
+	Pose decoded;
+	std::vector< uint8_t > data;
+	size_t keyframeBytes = 0;
+	size_t totalBytes = 0;
+	int decodedFrames = 0;
+	int decodeErrors = 0;
+	float maxError = 0.0f;
+	for ( int32_t frameId = 0; frameId < mFrames; frameId++ )
+	{
+		generator->generate( frameId );
+		pose.clear();
+		pose.mFrameId = frameId;
+		for ( size_t i = 0; i < Avatar::TOTAL_JOINTS; i++ )
+		{
+			pose.mOrientations[ i ] = Avatar::eulerToQuat( generator->getEulerDegrees( i ) );
+			pose.mOrientationMask.set( i );
+		}
+		pose.mPositions[ Avatar::HIP ] = generator->getRootPosition();
+		pose.mPositionMask.set( Avatar::HIP );
+
+		encoder->encode( pose, &data );
+		totalBytes += data.size();
+		bool keyframe = ( data[ 0 ] & PoseCodec::FLAG_KEYFRAME ) != 0;
+		if ( keyframe )
+		{
+			keyframeBytes = std::max( keyframeBytes, data.size() );
+		}
+		else if ( frameId % 7 == 3 )
+		{
+			// lost delta, the following ones have to decode regardless
+			continue;
+		}
+
+		if ( ! decoder->decode( data.data(), data.size(), &decoded ) ||
+			 decoded.mFrameId != frameId || ! decoded.mOrientationMask.all() ||
+			 decoded.mPositions[ Avatar::HIP ].distance( pose.mPositions[ Avatar::HIP ] ) > 1e-4f )
+		{
+			decodeErrors++;
+			continue;
+		}
+
+		decodedFrames++;
+		for ( size_t i = 0; i < Avatar::TOTAL_JOINTS; i++ )
+		{
+			float d = math< float >::min( math< float >::abs( pose.mOrientations[ i ].dot( decoded.mOrientations[ i ] ) ), 1.0f );
+			maxError = math< float >::max( maxError, toDegrees( 2.0f * math< float >::acos( d ) ) );
+		}
+	}
+
+	bool passed = decodeErrors == 0 && maxError <= maxAllowedError;
+	if ( ! passed )
+	{
+		console() << "Error: pose codec round trip failed, " << decodeErrors << " decode errors, max error "
+				  << maxError << " degrees" << std::endl;
+		mFailed = true;
+	}
+
+	JsonTree codec = JsonTree::makeObject( "codec" );
+	codec.pushBack( JsonTree( "keyframe_bytes", static_cast< int >( keyframeBytes ) ) );
+	codec.pushBack( JsonTree( "mean_bytes", mFrames > 0 ? double( totalBytes ) / mFrames : 0.0 ) );
+	codec.pushBack( JsonTree( "frames_decoded", decodedFrames ) );
+	codec.pushBack( JsonTree( "decode_errors", decodeErrors ) );
+	codec.pushBack( JsonTree( "max_error_degrees", maxError ) );
+	codec.pushBack( JsonTree( "passed", passed ) );
+	return codec;
+}
+
+JsonTree AvatarBenchmarkApp::checkRetarget()
+{
+	const float maxAllowedError = 0.1f;
+
+	// the joints drive the nodes with their names, with the offsets derived from the bind pose
+	std::string xml = "<retarget offsets=\"bind\">";
+	for ( size_t i = 0; i < Avatar::TOTAL_JOINTS; i++ )
+	{
+		xml += "<joint source=\"" + toString( i ) + "\" target=\"" + Avatar::getJointName( i ) + "\" />";
+	}
+	xml += "</retarget>";
+	RetargetMapRef retargetMap = RetargetMap::create( DataSourceBuffer::create( Buffer( &xml[ 0 ], xml.size() ) ) );
+	AvatarRef avatar = Avatar::create( getAssetPath( "model/avatar.dae" ), retargetMap );
+
+	Vec3f positions[ Avatar::TOTAL_JOINTS ];
+	Quatf bind[ Avatar::TOTAL_JOINTS ];
+	Quatf orientations[ Avatar::TOTAL_JOINTS ];
+	avatar->update();
+	avatar->getJointTransforms( positions, bind );
+
+	// the other joints stay at identity, which is the bind pose, so only the rotated joint moves
+	Quatf rotation( Vec3f( 1.0f, 2.0f, 3.0f ).normalized(), 0.5f );
+	Pose pose;
+	pose.mOrientationMask.set();
+	int checkedJoints = 0;
+	float maxError = 0.0f;
+	for ( size_t j = 0; j < Avatar::TOTAL_JOINTS; j++ )
+	{
+		if ( ! avatar->getJointNode( j ) )
+		{
+			continue;
+		}
+
+		std::fill( pose.mOrientations, pose.mOrientations + Avatar::TOTAL_JOINTS, Quatf() );
+		pose.mOrientations[ j ] = rotation;
+		avatar->setPose( pose );
+		avatar->update();
+		avatar->getJointTransforms( positions, orientations );
+
+		// the bind orientation, then the rotation in world space, in ci::Quatf order
+		Quatf expected = bind[ j ] * rotation;
+		float d = math< float >::min( math< float >::abs( expected.dot( orientations[ j ] ) ), 1.0f );
+		maxError = math< float >::max( maxError, toDegrees( 2.0f * math< float >::acos( d ) ) );
+		checkedJoints++;
+	}
+
+	bool passed = checkedJoints > 0 && maxError <= maxAllowedError;
+	if ( ! passed )
+	{
+		console() << "Error: retargeted joints are " << maxError << " degrees off the bind pose offsets" << std::endl;
+		mFailed = true;
+	}
+
+	JsonTree node = JsonTree::makeObject( "retarget" );
+	node.pushBack( JsonTree( "checked_joints", checkedJoints ) );
+	node.pushBack( JsonTree( "max_error_degrees", maxError ) );
+	node.pushBack( JsonTree( "passed", passed ) );
+	return node;
+}
+
+JsonTree AvatarBenchmarkApp::checkDatabase( const std::string &name, int numFrames )
+{
+	const int numQueries = 500;
+	const int numVerified = 20;
+	const size_t sessionFrames = 10000;
+
+	PoseGeneratorRef generator = PoseGenerator::create( mSeed );
+	generator->setRate( mRate );
+	generator->setNoise( mNoise );
+
+	auto generatePose = [ & ]( int32_t frameId, Pose *pose )
+	{
+		generator->generate( frameId );
+		pose->clear();
+		pose->mFrameId = frameId;
+		for ( size_t i = 0; i < Avatar::TOTAL_JOINTS; i++ )
+		{
+			pose->mOrientations[ i ] = Avatar::eulerToQuat( generator->getEulerDegrees( i ) );
+		}
+		pose->mOrientationMask.set();
+	};
+
+	// added in sessions, so the generated poses do not have to fit in memory at once
+	Timer timer( true );
+	PoseDatabaseRef database = PoseDatabase::create();
+	std::vector< Pose > poses;
+	for ( int32_t frameId = 0; frameId < numFrames; )
+	{
+		poses.resize( std::min( sessionFrames, size_t( numFrames - frameId ) ) );
+		for ( Pose &pose : poses )
+		{
+			generatePose( frameId++, &pose );
+		}
+		database->addSession( poses, mRate );
+	}
+	database->buildIndex();
+	double buildMs = timer.getSeconds() * 1000.0;
+
+	// the queries are the poses of a different noise sequence between the database frames
+	generator->setNoise( mNoise * 2.0f );
+	Samples querySamples;
+	int exactMatches = 0;
+	int budgetMatches = 0;
+	Pose query;
+	for ( int q = 0; q < numQueries; q++ )
+	{
+		generatePose( numFrames + q * 7919, &query );
+		database->setMaxVisits( mDatabaseMaxVisits );
+		timer.start();
+		size_t nearest = database->findNearest( query );
+		querySamples.add( timer.getSeconds() * 1000.0 );
+		if ( q < numVerified )
+		{
+			// the exhaustive tree search verifies the index, the budgeted one is approximate
+			size_t linear = database->findNearestLinear( query );
+			database->setMaxVisits( 0 );
+			exactMatches += database->findNearest( query ) == linear ? 1 : 0;
+			budgetMatches += nearest == linear ? 1 : 0;
+		}
+	}
+
+	// the index has to find the nearest frame when the budget does not cut the search short
+	bool passed = exactMatches == numVerified;
+	if ( ! passed )
+	{
+		console() << "Error: the " << name << " index found " << exactMatches << " of " << numVerified
+				  << " nearest frames" << std::endl;
+		mFailed = true;
+	}
+
+	JsonTree node = JsonTree::makeObject( name );
+	node.pushBack( JsonTree( "frames", numFrames ) );
+	node.pushBack( JsonTree( "max_visits", mDatabaseMaxVisits ) );
+	node.pushBack( JsonTree( "build_ms", buildMs ) );
+	node.pushBack( samplesToJson( "query", querySamples ) );
+	node.pushBack( JsonTree( "exact_matches", exactMatches ) );
+	node.pushBack( JsonTree( "budget_matches", budgetMatches ) );
+	node.pushBack( JsonTree( "verified_queries", numVerified ) );
+	node.pushBack( JsonTree( "passed", passed ) );
+	return node;
+}
+
+JsonTree AvatarBenchmarkApp::checkGrounding()
+{
+	const int numSolves = 200;
+	const int numPoses = 200;
+	const float footHeight = 8.0f;
+	const float maxAllowedError = 0.5f;
+
+	// every foot is in contact and the hip follows at once, so the feet have to end up at the foot height
+	auto createGrounding = [ & ]()
+			{
+				FootGroundingRef grounding = FootGrounding::create();
+				grounding->setFootHeight( footHeight );
+				grounding->setContactThresholds( 1e6f, 1e6f );
+				grounding->setHipSmoothing( 0.0f );
+				return grounding;
+			};
+	FootGroundingRef grounding = createGrounding();
+	FootGroundingRef solver = createGrounding();
+
+	// as many avatars as the renderer would ground, each in a pose of its own
+	std::vector< AvatarRef > avatars( mGroundingAvatars );
+	for ( AvatarRef &avatar : avatars )
+	{
+		avatar = Avatar::create( getAssetPath( "model/avatar.dae" ) );
+	}
+	auto poseAvatars = [ & ]( int32_t frameId )
+			{
+				for ( size_t i = 0; i < avatars.size(); i++ )
+				{
+					mPoseGenerator->generate( frameId + static_cast< int32_t >( i ) );
+					mPoseGenerator->apply( avatars[ i ] );
+				}
+			};
+
+	// apply() with the gathers and the scatters, and the solver alone on freshly gathered chains,
+	// as a solve replaces the orientations it starts from
+	solver->resize( avatars.size() );
+	Samples applySamples;
+	Samples solveSamples;
+	for ( int i = 0; i < numSolves; i++ )
+	{
+		double time = i / mRate;
+		poseAvatars( i );
+		Timer timer( true );
+		grounding->apply( avatars, time );
+		applySamples.add( timer.getSeconds() * 1000.0 );
+
+		poseAvatars( i );
+		for ( size_t j = 0; j < avatars.size(); j++ )
+		{
+			solver->gather( j, avatars[ j ] );
+		}
+		timer.start();
+		solver->solve( time );
+		solveSamples.add( timer.getSeconds() * 1000.0 );
+	}
+	avatars.clear();
+
+	grounding->reset();
+	Vec3f positions[ Avatar::TOTAL_JOINTS ];
+	Quatf orientations[ Avatar::TOTAL_JOINTS ];
+	float maxError = 0.0f;
+	for ( int32_t frameId = 0; frameId < numPoses; frameId++ )
+	{
+		mPoseGenerator->generate( frameId );
+		mPoseGenerator->apply( mAvatar );
+		grounding->apply( mAvatar, frameId / mRate );
+
+		mAvatar->getJointTransforms( positions, orientations );
+		for ( size_t joint : { Avatar::LFOOT, Avatar::RFOOT } )
+		{
+			maxError = math< float >::max( maxError, math< float >::abs( positions[ joint ].y - footHeight ) );
+		}
+	}
+
+	bool passed = maxError <= maxAllowedError;
+	if ( ! passed )
+	{
+		console() << "Error: grounded feet are " << maxError << " off the ground" << std::endl;
+		mFailed = true;
+	}
+
+	JsonTree node = JsonTree::makeObject( "grounding" );
+	node.pushBack( JsonTree( "avatars", mGroundingAvatars ) );
+	node.pushBack( samplesToJson( "apply", applySamples ) );
+	node.pushBack( samplesToJson( "solve", solveSamples ) );
+	node.pushBack( JsonTree( "max_foot_error", maxError ) );
+	node.pushBack( JsonTree( "passed", passed ) );
+	return node;
+}
+
+double AvatarBenchmarkApp::Samples::getMean() const
+{
+	if ( mValues.empty() )
+	{
+		return 0.0;
+	}
+
+	double sum = 0.0;
+	for ( double v : mValues )
+	{
+		sum += v;
+	}
+	return sum / mValues.size();
+}
+
+double AvatarBenchmarkApp::Samples::getPercentile( double p ) const
+{
+	if ( mValues.empty() )
+	{
+		return 0.0;
+	}
+
+	std::vector< double > sorted( mValues );
+	size_t n = std::min( static_cast< size_t >( p * 0.01 * sorted.size() ), sorted.size() - 1 );
+	std::nth_element( sorted.begin(), sorted.begin() + n, sorted.end() );
+	return sorted[ n ];
+}
+
+double AvatarBenchmarkApp::Samples::getMin() const
+{
+	return mValues.empty() ? 0.0 : *std::min_element( mValues.begin(), mValues.end() );
+}
+
+JsonTree AvatarBenchmarkApp::samplesToJson( const std::string &name, const Samples &samples ) const
+{
+	JsonTree node = JsonTree::makeObject( name );
+	node.pushBack( JsonTree( "mean", samples.getMean() ) );
+	node.pushBack( JsonTree( "median", samples.getPercentile( 50.0 ) ) );
+	node.pushBack( JsonTree( "p95", samples.getPercentile( 95.0 ) ) );
+	node.pushBack( JsonTree( "min", samples.getMin() ) );
+	return node;
+}
+
+void AvatarBenchmarkApp::writeResults()
+{
+	// skinning cannot be timed separately from the skeleton update in the loader
+	std::map< std::string, double > means;
+	means[ "apply" ] = mApplySamples.getMean();
+	means[ "skeleton" ] = mSkeletonSamples.getMean();
+	means[ "skinning" ] = std::max( mSkinnedUpdateSamples.getMean() - mSkeletonSamples.getMean(), 0.0 );
+	means[ "draw" ] = mDrawSamples.getMean();
+	means[ "frame" ] = mFrameSamples.getMean();
+
+	JsonTree metrics = JsonTree::makeObject( "metrics" );
+	metrics.pushBack( samplesToJson( "apply", mApplySamples ) );
+	metrics.pushBack( samplesToJson( "skeleton", mSkeletonSamples ) );
+	JsonTree skinning = JsonTree::makeObject( "skinning" );
+	skinning.pushBack( JsonTree( "mean", means[ "skinning" ] ) );
+	metrics.pushBack( skinning );
+	metrics.pushBack( samplesToJson( "skeleton_skinning", mSkinnedUpdateSamples ) );
+	metrics.pushBack( samplesToJson( "draw", mDrawSamples ) );
+	metrics.pushBack( samplesToJson( "frame", mFrameSamples ) );
+
+	JsonTree regressions = JsonTree::makeArray( "regressions" );
+	if ( fs::exists( mBaselinePath ) )
+	{
+		JsonTree baseline( loadFile( mBaselinePath ) );
+		for ( const auto &m : means )
+		{
+			std::string key = "metrics." + m.first + ".mean";
+			if ( ! baseline.hasChild( key ) )
+			{
+				continue;
+			}
+
+			double base = baseline.getChild( key ).getValue< double >();
+			if ( m.second > base * ( 1.0 + mTolerance * 0.01 ) )
+			{
+				console() << "Regression: " << m.first << " " << m.second << " ms, baseline " << base << " ms" << std::endl;
+				regressions.pushBack( JsonTree( "", m.first ) );
+			}
+		}
+	}
+	else
+	{
+		console() << "Warning: baseline not found " << mBaselinePath << std::endl;
+	}
+	mFailed |= regressions.hasChildren();
+
+	JsonTree results = JsonTree::makeObject();
+	results.pushBack( JsonTree( "model", "model/avatar.dae" ) );
+	results.pushBack( JsonTree( "frames", mFrames ) );
+	results.pushBack( JsonTree( "rate", mRate ) );
+	results.pushBack( JsonTree( "noise", mNoise ) );
+	results.pushBack( JsonTree( "seed", static_cast< int >( mSeed ) ) );
+	results.pushBack( metrics );
+	results.pushBack( regressions );
+	results.pushBack( checkCodec() );
+	results.pushBack( checkRetarget() );
+	if ( mDatabaseFrames > 0 )
+	{
+		results.pushBack( checkDatabase( "database", mDatabaseFrames ) );
+	}
+	if ( mDatabaseTarget )
+	{
+		// about 2 GB of features
+		results.pushBack( checkDatabase( "database_target", TARGET_DATABASE_FRAMES ) );
+	}
+	if ( mGroundingAvatars > 0 )
+	{
+		results.pushBack( checkGrounding() );
+	}
+
+	if ( mPoseBuffer )
+	{
+		// every invalid message has to be rejected as invalid, not lost among the late ones
+		bool invalidDropped = mPoseBuffer->getInvalidMessages() == mInvalidMessagesSent;
+		if ( ! invalidDropped )
+		{
+			console() << "Error: invalid joint ids were not dropped" << std::endl;
+		}
+		mFailed |= ! invalidDropped || mCoherenceErrors > 0;
+
+		JsonTree stress = JsonTree::makeObject( "stress" );
+		stress.pushBack( JsonTree( "senders", mSenders ) );
+		stress.pushBack( JsonTree( "frames_sent", static_cast< int >( mNextSenderFrameId ) ) );
+		stress.pushBack( JsonTree( "poses_applied", mPosesReceived ) );
+		stress.pushBack( JsonTree( "messages_dropped", mPoseBuffer->getDroppedMessages() ) );
+		stress.pushBack( JsonTree( "incomplete_frames", mPoseBuffer->getIncompleteFrames() ) );
+		stress.pushBack( JsonTree( "invalid_messages_sent", static_cast< uint32_t >( mInvalidMessagesSent ) ) );
+		stress.pushBack( JsonTree( "invalid_messages_dropped", mPoseBuffer->getInvalidMessages() ) );
+		stress.pushBack( JsonTree( "coherence_errors", mCoherenceErrors ) );
+		stress.pushBack( JsonTree( "invalid_joints_dropped", invalidDropped ) );
+		results.pushBack( stress );
+	}
+
+	results.write( writeFile( mOutputPath ) );
+	console() << "Results written to " << mOutputPath << std::endl;
+	if ( mUpdateBaseline )
+	{
+		results.write( writeFile( mBaselinePath ) );
+		console() << "Baseline updated " << mBaselinePath << std::endl;
+	}
+}
+
+CINDER_APP_BASIC( AvatarBenchmarkApp, RendererGl )
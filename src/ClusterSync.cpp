@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <thread>
+
+#include "ClusterSync.h"
+#include "LatencyStats.h"
+
+// followers that did not report for this long are left out of the lag
+static const double FOLLOWER_TIMEOUT = 2.0;
+// longer frame intervals, e.g. after a stall, are clamped in the estimate
+static const double MAX_FRAME_INTERVAL = 0.5;
+// rate at which the clock offset follows larger samples, the minimum is taken immediately
+static const double CLOCK_OFFSET_RELAXATION = 0.001;
+// rate at which the frame interval estimate follows the measured intervals
+static const double FRAME_INTERVAL_SMOOTHING = 0.1;
+// announcements kept for frames that are not due yet, older ones are dropped
+static const size_t MAX_ANNOUNCEMENTS = 256;
+
+ClusterSync::ClusterSync( mndl::osc::Server *listener ) :
+	mListener( listener )
+{
+	mHandlerIds.push_back( mListener->registerOscReceived(
+			&ClusterSync::syncReceived, this, "/sync", "idd" ) );
+	mHandlerIds.push_back( mListener->registerOscReceived(
+			&ClusterSync::lagReceived, this, "/sync/lag", "iifi" ) );
+}
+
+ClusterSync::~ClusterSync()
+{
+	for ( uint32_t handlerId : mHandlerIds )
+	{
+		mListener->unregisterOscReceived( handlerId );
+	}
+}
+
+void ClusterSync::setMode( Mode mode )
+{
+	mMode = mode;
+
+	std::lock_guard< std::mutex > lock( mMutex );
+	mAnnouncements.clear();
+	mFrameId = -1;
+	mLastAnnouncedFrameId = -1;
+	mDeadlinePending = false;
+	mClockOffsetValid = false;
+	mFollowerLags.clear();
+}
+
+void ClusterSync::setPeer( const std::string &hosts, int port )
+{
+	// the osc client socket does not enable SO_BROADCAST, the master sends to each follower
+	mClients.clear();
+	std::istringstream stream( hosts );
+	std::string host;
+	while ( std::getline( stream, host, ',' ) )
+	{
+		host.erase( 0, host.find_first_not_of( " \t" ) );
+		host.erase( host.find_last_not_of( " \t" ) + 1 );
+		if ( ! host.empty() )
+		{
+			mClients.push_back( std::make_shared< mndl::osc::Client >( host, port ) );
+		}
+	}
+}
+
+int32_t ClusterSync::beginFrame( int32_t latestFrameId )
+{
+	double now = LatencyStats::now();
+	if ( mLastFrameStart >= 0.0 )
+	{
+		double interval = std::min( now - mLastFrameStart, MAX_FRAME_INTERVAL );
+		mFrameInterval += ( interval - mFrameInterval ) * FRAME_INTERVAL_SMOOTHING;
+	}
+	mLastFrameStart = now;
+
+	if ( mMode == MODE_OFF )
+	{
+		mFrameId = latestFrameId;
+		mDeadlinePending = false;
+		return mFrameId;
+	}
+
+	if ( mMode == MODE_MASTER && latestFrameId >= 0 && latestFrameId != mLastAnnouncedFrameId )
+	{
+		// announced a delay ahead, it is displayed in a later frame
+		double deadline = now + mPresentationDelay;
+		mLastAnnouncedFrameId = latestFrameId;
+		mndl::osc::Message message( "/sync" );
+		message.addArg( latestFrameId );
+		message.addArg( deadline );
+		message.addArg( now );
+		for ( const auto &client : mClients )
+		{
+			client->send( message );
+		}
+
+		std::lock_guard< std::mutex > lock( mMutex );
+		addAnnouncement( latestFrameId, deadline );
+	}
+
+	// the latest frame due before the next one, earlier ones are skipped
+	std::lock_guard< std::mutex > lock( mMutex );
+	double offset = mMode == MODE_FOLLOWER ? mClockOffset : 0.0;
+	while ( ! mAnnouncements.empty() && mAnnouncements.front().mDeadline + offset < now + mFrameInterval )
+	{
+		mFrameId = mAnnouncements.front().mFrameId;
+		mDeadline = mAnnouncements.front().mDeadline + offset;
+		mDeadlinePending = true;
+		mAnnouncements.pop_front();
+	}
+
+	return mFrameId;
+}
+
+void ClusterSync::waitForDeadline( int32_t displayedFrameId )
+{
+	// the same frame is displayed again or none is due yet
+	if ( ! mDeadlinePending )
+	{
+		return;
+	}
+	mDeadlinePending = false;
+
+	// frames are picked when due before the next frame, a longer wait means a bad clock offset
+	// or stalled announcements, the swap is held at most a frame interval
+	double wait = std::min( mDeadline - LatencyStats::now(), mFrameInterval );
+	if ( wait > 0.0 )
+	{
+		std::this_thread::sleep_for( std::chrono::duration< double >( wait ) );
+	}
+
+	mLag = static_cast< float >( ( LatencyStats::now() - mDeadline ) * 1000.0 );
+	if ( mMode == MODE_FOLLOWER )
+	{
+		mndl::osc::Message message( "/sync/lag" );
+		message.addArg( mFollowerId );
+		message.addArg( mFrameId );
+		message.addArg( mLag );
+		message.addArg( displayedFrameId >= 0 ? mFrameId - displayedFrameId : 0 );
+		for ( const auto &client : mClients )
+		{
+			client->send( message );
+		}
+	}
+}
+
+void ClusterSync::addAnnouncement( int32_t frameId, double deadline )
+{
+	if ( ! mAnnouncements.empty() && mAnnouncements.back().mFrameId == frameId )
+	{
+		return;
+	}
+
+	mAnnouncements.push_back( Announcement { frameId, deadline } );
+	if ( mAnnouncements.size() > MAX_ANNOUNCEMENTS )
+	{
+		mAnnouncements.pop_front();
+	}
+}
+
+float ClusterSync::getMaxFollowerLag()
+{
+	double now = LatencyStats::now();
+	float maxLag = 0.0f;
+
+	std::lock_guard< std::mutex > lock( mMutex );
+	for ( const auto &follower : mFollowerLags )
+	{
+		if ( now - follower.second.mTime < FOLLOWER_TIMEOUT )
+		{
+			maxLag = std::max( maxLag, follower.second.mLag );
+		}
+	}
+	return maxLag;
+}
+
+bool ClusterSync::syncReceived( const mndl::osc::Message &message )
+{
+	if ( mMode != MODE_FOLLOWER )
+	{
+		return false;
+	}
+
+	double now = LatencyStats::now();
+	int32_t frameId = message.getArg< int32_t >( 0 );
+	double deadline = message.getArg< double >( 1 );
+	double masterTime = message.getArg< double >( 2 );
+
+	std::lock_guard< std::mutex > lock( mMutex );
+	// the smallest difference is the clock offset plus the minimum network delay
+	double offset = now - masterTime;
+	if ( ! mClockOffsetValid || offset < mClockOffset )
+	{
+		mClockOffset = offset;
+		mClockOffsetValid = true;
+	}
+	else
+	{
+		mClockOffset += ( offset - mClockOffset ) * CLOCK_OFFSET_RELAXATION;
+	}
+
+	addAnnouncement( frameId, deadline );
+	return false;
+}
+
+bool ClusterSync::lagReceived( const mndl::osc::Message &message )
+{
+	if ( mMode != MODE_MASTER )
+	{
+		return false;
+	}
+
+	int followerId = message.getArg< int32_t >( 0 );
+	float lag = message.getArg< float >( 2 );
+
+	std::lock_guard< std::mutex > lock( mMutex );
+	FollowerLag &follower = mFollowerLags[ followerId ];
+	follower.mLag = lag;
+	follower.mTime = LatencyStats::now();
+	return false;
+}
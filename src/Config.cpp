@@ -1,43 +1,419 @@
+#include <algorithm>
+#include <sstream>
+
 #include "cinder/Utilities.h"
+#include "cinder/app/App.h"
 
 #include "Config.h"
 
 namespace mndl
 {
 
+bool Config::Value::operator==( const Value &rhs ) const
+{
+	return mNumbers[ 0 ] == rhs.mNumbers[ 0 ] && mNumbers[ 1 ] == rhs.mNumbers[ 1 ] &&
+		   mNumbers[ 2 ] == rhs.mNumbers[ 2 ] && mNumbers[ 3 ] == rhs.mNumbers[ 3 ] &&
+		   mString == rhs.mString;
+}
+
+bool Config::addVar( const std::string &name, Type type, void *var, const void *defVal )
+{
+	if ( mVarIndices.find( name ) != mVarIndices.end() )
+	{
+		ci::app::console() << "Warning: config var " << name << " is registered twice" << std::endl;
+		return false;
+	}
+
+	Var v;
+	v.mName = name;
+	v.mType = type;
+	v.mPtr = var;
+	load( type, defVal, &v.mDefault );
+	v.mLast = v.mDefault;
+	v.mDirty = false;
+	store( type, v.mDefault, var );
+
+	mVarIndices[ name ] = mVars.size();
+	mVars.push_back( v );
+	return true;
+}
+
+Config::Var * Config::findVar( const std::string &name )
+{
+	auto it = mVarIndices.find( name );
+	if ( it == mVarIndices.end() )
+	{
+		return nullptr;
+	}
+	return &mVars[ it->second ];
+}
+
+const Config::Var * Config::findVar( const std::string &name ) const
+{
+	return const_cast< Config * >( this )->findVar( name );
+}
+
+void Config::setChangedFn( const std::string &name, const std::function< void () > &changedFn )
+{
+	Var *var = findVar( name );
+	if ( ! var )
+	{
+		ci::app::console() << "Warning: unknown config var " << name << std::endl;
+		return;
+	}
+
+	size_t index = var - &mVars[ 0 ];
+	auto watched = std::find( mWatchedVars.begin(), mWatchedVars.end(), index );
+	if ( changedFn && watched == mWatchedVars.end() )
+	{
+		mWatchedVars.push_back( index );
+	}
+	else if ( ! changedFn && watched != mWatchedVars.end() )
+	{
+		mWatchedVars.erase( watched );
+	}
+
+	var->mChangedFn = changedFn;
+	if ( changedFn )
+	{
+		changedFn();
+	}
+}
+
+void Config::update()
+{
+	for ( size_t index : mWatchedVars )
+	{
+		checkChanged( mVars[ index ] );
+	}
+}
+
+void Config::checkChanged( Var &var )
+{
+	Value value;
+	load( var.mType, var.mPtr, &value );
+	if ( value == var.mLast )
+	{
+		return;
+	}
+
+	var.mLast = value;
+	var.mDirty = true;
+	if ( var.mChangedFn )
+	{
+		var.mChangedFn();
+	}
+}
+
+bool Config::isDirty( const std::string &name ) const
+{
+	const Var *var = findVar( name );
+	if ( ! var )
+	{
+		return false;
+	}
+	if ( var->mDirty )
+	{
+		return true;
+	}
+
+	Value value;
+	load( var->mType, var->mPtr, &value );
+	return value != var->mLast;
+}
+
+void Config::clearDirty( const std::string &name )
+{
+	Var *var = findVar( name );
+	if ( var )
+	{
+		// update() keeps the last value of the watched vars, the others are compared against it when asked
+		if ( ! var->mChangedFn )
+		{
+			load( var->mType, var->mPtr, &var->mLast );
+		}
+		var->mDirty = false;
+	}
+}
+
 void Config::read( const ci::DataSourceRef &source )
 {
 	ci::XmlTree doc = ci::XmlTree( source );
-	for ( auto f : mConfigReadCallbacks )
+
+	// one pass over the document, the vars missing from it get their defaults
+	std::vector< bool > found( mVars.size(), false );
+	for ( const auto &child : doc.getChildren() )
 	{
-		f( doc );
+		readNode( *child, child->getTag(), &found );
+	}
+
+	for ( size_t i = 0; i < mVars.size(); i++ )
+	{
+		if ( ! found[ i ] )
+		{
+			store( mVars[ i ].mType, mVars[ i ].mDefault, mVars[ i ].mPtr );
+		}
+		checkChanged( mVars[ i ] );
+	}
+}
+
+void Config::readNode( const ci::XmlTree &node, const std::string &path, std::vector< bool > *found )
+{
+	if ( ! node.isElement() )
+	{
+		return;
+	}
+
+	auto it = mVarIndices.find( path );
+	if ( it != mVarIndices.end() )
+	{
+		Var &var = mVars[ it->second ];
+		Value value = var.mDefault;
+		readValue( var.mType, node, &value );
+		store( var.mType, value, var.mPtr );
+		( *found )[ it->second ] = true;
+		return;
+	}
+
+	for ( const auto &child : node.getChildren() )
+	{
+		readNode( *child, path + "/" + child->getTag(), found );
 	}
 }
 
 void Config::write( const ci::DataTargetRef &target )
 {
 	ci::XmlTree doc = ci::XmlTree::createDoc();
-	for ( auto f : mConfigWriteCallbacks )
+
+	// the group elements by path, children are kept in stable nodes, so the pointers stay valid
+	std::unordered_map< std::string, ci::XmlTree * > groups;
+	groups[ "" ] = &doc;
+	for ( const Var &var : mVars )
 	{
-		f( doc );
+		size_t start = 0;
+		ci::XmlTree *parent = &doc;
+		for ( size_t slash = var.mName.find( '/' ); slash != std::string::npos;
+			  slash = var.mName.find( '/', slash + 1 ) )
+		{
+			std::string groupPath = var.mName.substr( 0, slash );
+			auto it = groups.find( groupPath );
+			if ( it == groups.end() )
+			{
+				parent->push_back( ci::XmlTree( groupPath.substr( start ), "" ) );
+				it = groups.insert( std::make_pair( groupPath, parent->getChildren().back().get() ) ).first;
+			}
+			parent = it->second;
+			start = slash + 1;
+		}
+
+		ci::XmlTree node( var.mName.substr( start ), "" );
+		Value value;
+		load( var.mType, var.mPtr, &value );
+		writeValue( var.mType, value, node );
+		parent->push_back( node );
 	}
+
 	doc.write( target );
 }
 
-void Config::addChild( const std::string &name, ci::XmlTree &xml )
+void Config::load( Type type, const void *ptr, Value *value )
+{
+	std::fill( value->mNumbers, value->mNumbers + 4, 0.0 );
+	value->mString.clear();
+	double *n = value->mNumbers;
+	switch ( type )
+	{
+		case TYPE_BOOL:
+			n[ 0 ] = *static_cast< const bool * >( ptr ) ? 1.0 : 0.0;
+			break;
+		case TYPE_INT:
+			n[ 0 ] = *static_cast< const int * >( ptr );
+			break;
+		case TYPE_FLOAT:
+			n[ 0 ] = *static_cast< const float * >( ptr );
+			break;
+		case TYPE_DOUBLE:
+			n[ 0 ] = *static_cast< const double * >( ptr );
+			break;
+		case TYPE_STRING:
+			value->mString = *static_cast< const std::string * >( ptr );
+			break;
+		case TYPE_VEC2I:
+		{
+			const ci::Vec2i &v = *static_cast< const ci::Vec2i * >( ptr );
+			n[ 0 ] = v.x;
+			n[ 1 ] = v.y;
+			break;
+		}
+		case TYPE_VEC2F:
+		{
+			const ci::Vec2f &v = *static_cast< const ci::Vec2f * >( ptr );
+			n[ 0 ] = v.x;
+			n[ 1 ] = v.y;
+			break;
+		}
+		case TYPE_VEC3F:
+		{
+			const ci::Vec3f &v = *static_cast< const ci::Vec3f * >( ptr );
+			n[ 0 ] = v.x;
+			n[ 1 ] = v.y;
+			n[ 2 ] = v.z;
+			break;
+		}
+		case TYPE_QUATF:
+		{
+			const ci::Quatf &q = *static_cast< const ci::Quatf * >( ptr );
+			n[ 0 ] = q.v.x;
+			n[ 1 ] = q.v.y;
+			n[ 2 ] = q.v.z;
+			n[ 3 ] = q.w;
+			break;
+		}
+		case TYPE_COLOR:
+		{
+			const ci::Color &c = *static_cast< const ci::Color * >( ptr );
+			n[ 0 ] = c.r;
+			n[ 1 ] = c.g;
+			n[ 2 ] = c.b;
+			n[ 3 ] = 1.0;
+			break;
+		}
+		case TYPE_COLORA:
+		{
+			const ci::ColorA &c = *static_cast< const ci::ColorA * >( ptr );
+			n[ 0 ] = c.r;
+			n[ 1 ] = c.g;
+			n[ 2 ] = c.b;
+			n[ 3 ] = c.a;
+			break;
+		}
+	}
+}
+
+void Config::store( Type type, const Value &value, void *ptr )
+{
+	const double *n = value.mNumbers;
+	switch ( type )
+	{
+		case TYPE_BOOL:
+			*static_cast< bool * >( ptr ) = n[ 0 ] != 0.0;
+			break;
+		case TYPE_INT:
+			*static_cast< int * >( ptr ) = static_cast< int >( n[ 0 ] );
+			break;
+		case TYPE_FLOAT:
+			*static_cast< float * >( ptr ) = static_cast< float >( n[ 0 ] );
+			break;
+		case TYPE_DOUBLE:
+			*static_cast< double * >( ptr ) = n[ 0 ];
+			break;
+		case TYPE_STRING:
+			*static_cast< std::string * >( ptr ) = value.mString;
+			break;
+		case TYPE_VEC2I:
+			*static_cast< ci::Vec2i * >( ptr ) = ci::Vec2i( static_cast< int >( n[ 0 ] ), static_cast< int >( n[ 1 ] ) );
+			break;
+		case TYPE_VEC2F:
+			*static_cast< ci::Vec2f * >( ptr ) = ci::Vec2f( n[ 0 ], n[ 1 ] );
+			break;
+		case TYPE_VEC3F:
+			*static_cast< ci::Vec3f * >( ptr ) = ci::Vec3f( n[ 0 ], n[ 1 ], n[ 2 ] );
+			break;
+		case TYPE_QUATF:
+			*static_cast< ci::Quatf * >( ptr ) = ci::Quatf( n[ 3 ], n[ 0 ], n[ 1 ], n[ 2 ] );
+			break;
+		case TYPE_COLOR:
+			*static_cast< ci::Color * >( ptr ) = ci::Color( n[ 0 ], n[ 1 ], n[ 2 ] );
+			break;
+		case TYPE_COLORA:
+			*static_cast< ci::ColorA * >( ptr ) = ci::ColorA( n[ 0 ], n[ 1 ], n[ 2 ], n[ 3 ] );
+			break;
+	}
+}
+
+void Config::readValue( Type type, const ci::XmlTree &node, Value *value )
 {
-	std::vector< std::string > tokens = ci::split( name, "/" );
-	std::string parentId = "";
-	for ( const std::string &token : tokens )
+	double *n = value->mNumbers;
+	switch ( type )
 	{
-		if ( ! xml.hasChild( parentId + "/" + token ) )
+		case TYPE_BOOL:
+			n[ 0 ] = node.getAttributeValue( "value", n[ 0 ] != 0.0 ) ? 1.0 : 0.0;
+			break;
+		case TYPE_INT:
+		case TYPE_FLOAT:
+		case TYPE_DOUBLE:
+			n[ 0 ] = node.getAttributeValue( "value", n[ 0 ] );
+			break;
+		case TYPE_STRING:
+			value->mString = node.getAttributeValue( "value", value->mString );
+			break;
+		case TYPE_VEC2I:
+		case TYPE_VEC2F:
+		case TYPE_VEC3F:
+		case TYPE_QUATF:
+		{
+			static const char *names[ 4 ] = { "x", "y", "z", "w" };
+			size_t count = type == TYPE_QUATF ? 4 : ( type == TYPE_VEC3F ? 3 : 2 );
+			for ( size_t i = 0; i < count; i++ )
+			{
+				n[ i ] = node.getAttributeValue( names[ i ], n[ i ] );
+			}
+			break;
+		}
+		case TYPE_COLOR:
+		case TYPE_COLORA:
 		{
-			if ( parentId == "" )
-				xml.push_back( ci::XmlTree( token, "" ) );
-			else
-				xml.getChild( parentId ).push_back( ci::XmlTree( token, "" ) );
+			ci::ColorA def( n[ 0 ], n[ 1 ], n[ 2 ], n[ 3 ] );
+			ci::ColorA c = hexToColor( node.getAttributeValue( "value", colorToHex( def ) ) );
+			n[ 0 ] = c.r;
+			n[ 1 ] = c.g;
+			n[ 2 ] = c.b;
+			n[ 3 ] = type == TYPE_COLOR ? 1.0 : c.a;
+			break;
 		}
-		parentId += "/" + token;
+	}
+}
+
+void Config::writeValue( Type type, const Value &value, ci::XmlTree &node )
+{
+	const double *n = value.mNumbers;
+	switch ( type )
+	{
+		case TYPE_BOOL:
+			node.setAttribute( "value", n[ 0 ] != 0.0 );
+			break;
+		case TYPE_INT:
+			node.setAttribute( "value", static_cast< int >( n[ 0 ] ) );
+			break;
+		case TYPE_FLOAT:
+			node.setAttribute( "value", static_cast< float >( n[ 0 ] ) );
+			break;
+		case TYPE_DOUBLE:
+			node.setAttribute( "value", n[ 0 ] );
+			break;
+		case TYPE_STRING:
+			node.setAttribute( "value", value.mString );
+			break;
+		case TYPE_VEC2I:
+			node.setAttribute( "x", static_cast< int >( n[ 0 ] ) );
+			node.setAttribute( "y", static_cast< int >( n[ 1 ] ) );
+			break;
+		case TYPE_VEC2F:
+		case TYPE_VEC3F:
+		case TYPE_QUATF:
+		{
+			static const char *names[ 4 ] = { "x", "y", "z", "w" };
+			size_t count = type == TYPE_QUATF ? 4 : ( type == TYPE_VEC3F ? 3 : 2 );
+			for ( size_t i = 0; i < count; i++ )
+			{
+				node.setAttribute( names[ i ], static_cast< float >( n[ i ] ) );
+			}
+			break;
+		}
+		case TYPE_COLOR:
+		case TYPE_COLORA:
+			node.setAttribute( "value", colorToHex( ci::ColorA( n[ 0 ], n[ 1 ], n[ 2 ], n[ 3 ] ) ) );
+			break;
 	}
 }
 
@@ -70,37 +446,4 @@ ci::ColorA Config::hexToColor( const std::string &hexStr )
 	return ci::ColorA( r, g, b, a );
 }
 
-void Config::readVar( ci::ColorA *var, const ci::ColorA &defVal,
-					  const std::string &name, ci::XmlTree &xml )
-{
-	std::string colorStr = xml.hasChild( name ) ?
-							xml.getChild( name ).getAttributeValue( "value", colorToHex( defVal ) ) :
-							colorToHex( defVal );
-	*var = hexToColor( colorStr );
-}
-
-void Config::writeVar( ci::ColorA *var, const std::string &name, ci::XmlTree &xml )
-{
-	addChild( name, xml );
-	ci::XmlTree &node = xml.getChild( name );
-	node.setAttribute( "value", colorToHex( *var ) );
-	xml.push_back( node );
-}
-
-void Config::readVar( ci::Color *var, const ci::Color &defVal,
-					  const std::string &name, ci::XmlTree &xml )
-{
-	std::string colorStr = xml.hasChild( name ) ?
-							xml.getChild( name ).getAttributeValue( "value", colorToHex( defVal ) ) :
-							colorToHex( defVal );
-	*var = ci::Color( hexToColor( colorStr ) );
-}
-
-void Config::writeVar( ci::Color *var, const std::string &name, ci::XmlTree &xml )
-{
-	addChild( name, xml );
-	ci::XmlTree &node = xml.getChild( name );
-	node.setAttribute( "value", colorToHex( *var ) );
-}
-
 }
@@ -0,0 +1,132 @@
+#include <cmath>
+
+#include "DynamicResolution.h"
+
+using namespace ci;
+
+// the smoothing of the gpu time per sample
+static const float GPU_TIME_SMOOTHING = 0.2f;
+// no scale change while the gpu time is this close to the target
+static const float TARGET_TOLERANCE = 0.05f;
+// the largest relative scale change per frame
+static const float MAX_SCALE_STEP = 0.05f;
+
+DynamicResolution::~DynamicResolution()
+{
+	if ( mQueriesCreated )
+	{
+		glDeleteQueries( NUM_QUERIES, mQueries );
+	}
+}
+
+void DynamicResolution::bind( const Vec2i &windowSize )
+{
+	if ( ! mQueriesCreated )
+	{
+		glGenQueries( NUM_QUERIES, mQueries );
+		std::fill( mQueryPending, mQueryPending + NUM_QUERIES, false );
+		mQueriesCreated = true;
+	}
+
+	// allocated at the full size, lower scales render to a corner of it
+	if ( ! mFbo || windowSize != mSize )
+	{
+		mSize = windowSize;
+		gl::Fbo::Format format;
+		format.enableDepthBuffer();
+		format.setMinFilter( GL_LINEAR );
+		format.setMagFilter( GL_LINEAR );
+		mFbo = gl::Fbo( std::max( mSize.x, 1 ), std::max( mSize.y, 1 ), format );
+	}
+
+	readQueries();
+	if ( ! mEnabled )
+	{
+		mScale = 1.0f;
+	}
+
+	// a query still in flight is skipped instead of waited for
+	if ( ! mQueryPending[ mQueryIndex ] )
+	{
+		glBeginQuery( GL_TIME_ELAPSED, mQueries[ mQueryIndex ] );
+	}
+
+	mFbo.bindFramebuffer();
+	gl::setViewport( Area( Vec2i::zero(), getScaledSize() ) );
+}
+
+void DynamicResolution::unbind()
+{
+	mFbo.unbindFramebuffer();
+	gl::setViewport( Area( Vec2i::zero(), mSize ) );
+
+	if ( ! mQueryPending[ mQueryIndex ] )
+	{
+		glEndQuery( GL_TIME_ELAPSED );
+		mQueryPending[ mQueryIndex ] = true;
+	}
+	mQueryIndex = ( mQueryIndex + 1 ) % NUM_QUERIES;
+}
+
+void DynamicResolution::draw( const Area &bounds )
+{
+	if ( ! mFbo )
+	{
+		return;
+	}
+
+	// the scene is in the lower left corner, the fbo texture is flipped
+	Vec2i size = getScaledSize();
+	Area source( 0, mSize.y - size.y, size.x, mSize.y );
+	gl::setMatricesWindow( bounds.getSize() );
+	gl::disableDepthRead();
+	gl::disableDepthWrite();
+	gl::color( Color::white() );
+	gl::draw( mFbo.getTexture(), source, Rectf( bounds ) );
+}
+
+Vec2i DynamicResolution::getScaledSize() const
+{
+	return Vec2i( std::max( int( mSize.x * mScale ), 1 ), std::max( int( mSize.y * mScale ), 1 ) );
+}
+
+void DynamicResolution::readQueries()
+{
+	for ( size_t i = 0; i < NUM_QUERIES; i++ )
+	{
+		if ( ! mQueryPending[ i ] )
+		{
+			continue;
+		}
+
+		GLint available = 0;
+		glGetQueryObjectiv( mQueries[ i ], GL_QUERY_RESULT_AVAILABLE, &available );
+		if ( ! available )
+		{
+			continue;
+		}
+
+		GLuint64 ns = 0;
+		glGetQueryObjectui64v( mQueries[ i ], GL_QUERY_RESULT, &ns );
+		mQueryPending[ i ] = false;
+		updateScale( static_cast< float >( ns * 1e-6 ) );
+	}
+}
+
+void DynamicResolution::updateScale( float gpuTime )
+{
+	mGpuTime += ( gpuTime - mGpuTime ) * GPU_TIME_SMOOTHING;
+	if ( ! mEnabled || mGpuTime <= 0.0f )
+	{
+		return;
+	}
+
+	// the cost is about proportional to the pixel count, which is the square of the scale
+	float ratio = mTargetTime / mGpuTime;
+	if ( std::abs( ratio - 1.0f ) < TARGET_TOLERANCE )
+	{
+		return;
+	}
+	float step = std::min( std::max( std::sqrt( ratio ), 1.0f - MAX_SCALE_STEP ), 1.0f + MAX_SCALE_STEP );
+	mScale = std::min( std::max( mScale * step, mMinScale ), 1.0f );
+}
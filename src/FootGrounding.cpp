@@ -0,0 +1,336 @@
+#include <algorithm>
+#include <cmath>
+
+#include "FootGrounding.h"
+
+using namespace ci;
+
+// root, middle and end joint of the chains
+static const size_t sChainJoints[ FootGrounding::NUM_CHAINS ][ 3 ] =
+{
+	{ Avatar::LTHIGH, Avatar::LSHIN, Avatar::LFOOT },
+	{ Avatar::RTHIGH, Avatar::RSHIN, Avatar::RFOOT },
+	{ Avatar::LSHOULDER, Avatar::LFOREARM, Avatar::LHAND },
+	{ Avatar::RSHOULDER, Avatar::RFOREARM, Avatar::RHAND }
+};
+
+// a fully extended chain flips its bend direction unpredictably
+static const float MAX_EXTENSION = 0.999f;
+static const float MIN_LENGTH = 1e-4f;
+static const float MAX_FRAME_INTERVAL = 0.5f;
+
+//! Hamilton product a * b, b is applied first.
+static inline void multiply( float aw, float ax, float ay, float az, float bw, float bx, float by, float bz,
+							 float &w, float &x, float &y, float &z )
+{
+	w = aw * bw - ax * bx - ay * by - az * bz;
+	x = aw * bx + ax * bw + ay * bz - az * by;
+	y = aw * by - ax * bz + ay * bw + az * bx;
+	z = aw * bz + ax * by - ay * bx + az * bw;
+}
+
+//! Half angle cosine and sine of the rotation from the angle with cosine \a cos0 to the angle with cosine \a cos1,
+//! both angles are in [0, pi].
+static inline void halfAngleDifference( float cos0, float cos1, float &halfCos, float &halfSin )
+{
+	float sin0 = std::sqrt( std::max( 1.0f - cos0 * cos0, 0.0f ) );
+	float sin1 = std::sqrt( std::max( 1.0f - cos1 * cos1, 0.0f ) );
+	float cosAngle = cos1 * cos0 + sin1 * sin0;
+	float sinAngle = sin1 * cos0 - cos1 * sin0;
+	halfCos = std::sqrt( std::max( 0.5f * ( 1.0f + cosAngle ), 0.0f ) );
+	halfSin = std::copysign( std::sqrt( std::max( 0.5f * ( 1.0f - cosAngle ), 0.0f ) ), sinAngle );
+}
+
+static inline float clampCos( float c )
+{
+	return std::min( std::max( c, -1.0f ), 1.0f );
+}
+
+void FootGrounding::setContactThresholds( float enter, float exit )
+{
+	mContactEnter = enter;
+	mContactExit = std::max( enter, exit );
+}
+
+void FootGrounding::apply( const std::vector< AvatarRef > &avatars, double time )
+{
+	resize( avatars.size() );
+	for ( size_t i = 0; i < avatars.size(); i++ )
+	{
+		gather( i, avatars[ i ] );
+	}
+	solve( time );
+	for ( size_t i = 0; i < avatars.size(); i++ )
+	{
+		scatter( i, avatars[ i ] );
+	}
+}
+
+void FootGrounding::apply( const AvatarRef &avatar, double time )
+{
+	apply( std::vector< AvatarRef >( 1, avatar ), time );
+}
+
+void FootGrounding::resize( size_t numAvatars )
+{
+	if ( numAvatars == mNumAvatars )
+	{
+		return;
+	}
+
+	mNumAvatars = numAvatars;
+	for ( auto &channel : mLanes )
+	{
+		channel.resize( numAvatars * NUM_CHAINS, 0.0f );
+	}
+	mHipOffsets.resize( numAvatars, 0.0f );
+}
+
+void FootGrounding::reset()
+{
+	std::fill( mLanes[ CONTACT ].begin(), mLanes[ CONTACT ].end(), 0.0f );
+	std::fill( mHipOffsets.begin(), mHipOffsets.end(), 0.0f );
+	mLastTime = -1.0;
+}
+
+void FootGrounding::gather( size_t index, const AvatarRef &avatar )
+{
+	Vec3f positions[ Avatar::TOTAL_JOINTS ];
+	Quatf orientations[ Avatar::TOTAL_JOINTS ];
+	avatar->getJointTransforms( positions, orientations );
+
+	// the hip offset of the last frame is still in the joints
+	Vec3f rootOffset = avatar->getRootOffset();
+
+	for ( size_t c = 0; c < NUM_CHAINS; c++ )
+	{
+		size_t lane = index * NUM_CHAINS + c;
+		const size_t *joints = sChainJoints[ c ];
+		bool arm = c >= LEFT_ARM;
+		bool mapped = avatar->getJointNode( joints[ 0 ] ) && avatar->getJointNode( joints[ 1 ] ) &&
+					  avatar->getJointNode( joints[ 2 ] );
+
+		mLanes[ ENABLED ][ lane ] = ( mapped && ( ! arm || mArmsEnabled ) ) ? 1.0f : 0.0f;
+		mLanes[ SUPPORT ][ lane ] = arm ? 0.0f : 1.0f;
+		mLanes[ REST_HEIGHT ][ lane ] = mGroundHeight + ( arm ? mHandHeight : mFootHeight );
+
+		for ( size_t j = 0; j < 3; j++ )
+		{
+			Vec3f p = positions[ joints[ j ] ] - rootOffset;
+			mLanes[ ROOT_X + j * 3 ][ lane ] = p.x;
+			mLanes[ ROOT_Y + j * 3 ][ lane ] = p.y;
+			mLanes[ ROOT_Z + j * 3 ][ lane ] = p.z;
+
+			const Quatf &q = orientations[ joints[ j ] ];
+			mLanes[ ROOT_QW + j * 4 ][ lane ] = q.w;
+			mLanes[ ROOT_QX + j * 4 ][ lane ] = q.v.x;
+			mLanes[ ROOT_QY + j * 4 ][ lane ] = q.v.y;
+			mLanes[ ROOT_QZ + j * 4 ][ lane ] = q.v.z;
+		}
+	}
+}
+
+void FootGrounding::solve( double time )
+{
+	float dt = static_cast< float >( time - mLastTime );
+	float alpha = ( mLastTime < 0.0 || dt > MAX_FRAME_INTERVAL ) ? 1.0f : dt / ( mHipSmoothing + dt );
+	mLastTime = time;
+
+	updateContacts();
+	updateHipOffsets( std::min( std::max( alpha, 0.0f ), 1.0f ) );
+	solveChains();
+}
+
+void FootGrounding::scatter( size_t index, const AvatarRef &avatar ) const
+{
+	avatar->setRootOffset( Vec3f( 0.0f, mHipOffsets[ index ], 0.0f ) );
+
+	for ( size_t c = 0; c < NUM_CHAINS; c++ )
+	{
+		size_t lane = index * NUM_CHAINS + c;
+		if ( mLanes[ ENABLED ][ lane ] == 0.0f )
+		{
+			continue;
+		}
+
+		// from the parent to the child, the end joint keeps its world orientation
+		for ( size_t j = 0; j < 3; j++ )
+		{
+			avatar->setJointWorldOrientation( sChainJoints[ c ][ j ],
+					Quatf( mLanes[ ROOT_QW + j * 4 ][ lane ], mLanes[ ROOT_QX + j * 4 ][ lane ],
+						   mLanes[ ROOT_QY + j * 4 ][ lane ], mLanes[ ROOT_QZ + j * 4 ][ lane ] ) );
+		}
+	}
+}
+
+void FootGrounding::updateContacts()
+{
+	const size_t n = mNumAvatars * NUM_CHAINS;
+	const float *__restrict rx = mLanes[ ROOT_X ].data();
+	const float *__restrict ry = mLanes[ ROOT_Y ].data();
+	const float *__restrict rz = mLanes[ ROOT_Z ].data();
+	const float *__restrict mx = mLanes[ MID_X ].data();
+	const float *__restrict my = mLanes[ MID_Y ].data();
+	const float *__restrict mz = mLanes[ MID_Z ].data();
+	const float *__restrict ex = mLanes[ END_X ].data();
+	const float *__restrict ey = mLanes[ END_Y ].data();
+	const float *__restrict ez = mLanes[ END_Z ].data();
+	const float *__restrict enabled = mLanes[ ENABLED ].data();
+	const float *__restrict support = mLanes[ SUPPORT ].data();
+	const float *__restrict rest = mLanes[ REST_HEIGHT ].data();
+	float *__restrict contact = mLanes[ CONTACT ].data();
+	float *__restrict hipOffset = mLanes[ HIP_OFFSET ].data();
+	const float contactEnter = mContactEnter;
+	const float contactExit = mContactExit;
+
+	// the channels are separate arrays, too many for the runtime alias checks of gcc
+#pragma GCC ivdep
+	for ( size_t i = 0; i < n; i++ )
+	{
+		// hysteresis, the contact holds up to the higher threshold
+		float height = ey[ i ] - rest[ i ];
+		float threshold = contact[ i ] > 0.5f ? contactExit : contactEnter;
+		contact[ i ] = ( height < threshold ? 1.0f : 0.0f ) * enabled[ i ];
+
+		// the highest root position from which the chain reaches the ground under its end
+		float ax = mx[ i ] - rx[ i ], ay = my[ i ] - ry[ i ], az = mz[ i ] - rz[ i ];
+		float bx = ex[ i ] - mx[ i ], by = ey[ i ] - my[ i ], bz = ez[ i ] - mz[ i ];
+		float reach = ( std::sqrt( ax * ax + ay * ay + az * az ) + std::sqrt( bx * bx + by * by + bz * bz ) ) * MAX_EXTENSION;
+		float dx = ex[ i ] - rx[ i ];
+		float dz = ez[ i ] - rz[ i ];
+		float maxRootY = rest[ i ] + std::sqrt( std::max( reach * reach - dx * dx - dz * dz, 0.0f ) );
+		hipOffset[ i ] = std::min( maxRootY - ry[ i ], 0.0f ) * contact[ i ] * support[ i ];
+	}
+}
+
+void FootGrounding::updateHipOffsets( float alpha )
+{
+	for ( size_t a = 0; a < mNumAvatars; a++ )
+	{
+		float *hipOffset = &mLanes[ HIP_OFFSET ][ a * NUM_CHAINS ];
+		float target = *std::min_element( hipOffset, hipOffset + NUM_CHAINS );
+		mHipOffsets[ a ] += alpha * ( target - mHipOffsets[ a ] );
+		std::fill( hipOffset, hipOffset + NUM_CHAINS, mHipOffsets[ a ] );
+	}
+}
+
+void FootGrounding::solveChains()
+{
+	const size_t n = mNumAvatars * NUM_CHAINS;
+	const float *__restrict rx = mLanes[ ROOT_X ].data();
+	const float *__restrict ry = mLanes[ ROOT_Y ].data();
+	const float *__restrict rz = mLanes[ ROOT_Z ].data();
+	const float *__restrict mx = mLanes[ MID_X ].data();
+	const float *__restrict my = mLanes[ MID_Y ].data();
+	const float *__restrict mz = mLanes[ MID_Z ].data();
+	const float *__restrict ex = mLanes[ END_X ].data();
+	const float *__restrict ey = mLanes[ END_Y ].data();
+	const float *__restrict ez = mLanes[ END_Z ].data();
+	float *__restrict rqw = mLanes[ ROOT_QW ].data();
+	float *__restrict rqx = mLanes[ ROOT_QX ].data();
+	float *__restrict rqy = mLanes[ ROOT_QY ].data();
+	float *__restrict rqz = mLanes[ ROOT_QZ ].data();
+	float *__restrict mqw = mLanes[ MID_QW ].data();
+	float *__restrict mqx = mLanes[ MID_QX ].data();
+	float *__restrict mqy = mLanes[ MID_QY ].data();
+	float *__restrict mqz = mLanes[ MID_QZ ].data();
+	const float *__restrict enabled = mLanes[ ENABLED ].data();
+	const float *__restrict rest = mLanes[ REST_HEIGHT ].data();
+	const float *__restrict contact = mLanes[ CONTACT ].data();
+	const float *__restrict hipOffset = mLanes[ HIP_OFFSET ].data();
+
+	// branchless, the disabled chains get identity rotations through the selects
+#pragma GCC ivdep
+	for ( size_t i = 0; i < n; i++ )
+	{
+		// the whole chain moves with the hip
+		float dy = hipOffset[ i ];
+		float aby = my[ i ] - ry[ i ];
+		float abx = mx[ i ] - rx[ i ], abz = mz[ i ] - rz[ i ];
+		float bcx = ex[ i ] - mx[ i ], bcy = ey[ i ] - my[ i ], bcz = ez[ i ] - mz[ i ];
+		float acx = ex[ i ] - rx[ i ], acy = ey[ i ] - ry[ i ], acz = ez[ i ] - rz[ i ];
+
+		// pinned to the ground in contact, otherwise only kept above it
+		float targetY = contact[ i ] > 0.5f ? rest[ i ] : std::max( ey[ i ] + dy, rest[ i ] );
+		float atx = acx, aty = targetY - ( ry[ i ] + dy ), atz = acz;
+
+		float lab = std::max( std::sqrt( abx * abx + aby * aby + abz * abz ), MIN_LENGTH );
+		float lbc = std::max( std::sqrt( bcx * bcx + bcy * bcy + bcz * bcz ), MIN_LENGTH );
+		float lac = std::max( std::sqrt( acx * acx + acy * acy + acz * acz ), MIN_LENGTH );
+		float latRaw = std::max( std::sqrt( atx * atx + aty * aty + atz * atz ), MIN_LENGTH );
+		float lat = std::min( std::max( latRaw, std::fabs( lab - lbc ) + MIN_LENGTH ), ( lab + lbc ) * MAX_EXTENSION );
+
+		// current and wanted angles between the root bone and the root to end line, and at the middle joint
+		float cosRoot0 = clampCos( ( acx * abx + acy * aby + acz * abz ) / ( lac * lab ) );
+		float cosMid0 = clampCos( -( abx * bcx + aby * bcy + abz * bcz ) / ( lab * lbc ) );
+		float cosRoot1 = clampCos( ( lab * lab + lat * lat - lbc * lbc ) / ( 2.0f * lab * lat ) );
+		float cosMid1 = clampCos( ( lab * lab + lbc * lbc - lat * lat ) / ( 2.0f * lab * lbc ) );
+		float cosSwing = clampCos( ( acx * atx + acy * aty + acz * atz ) / ( lac * latRaw ) );
+
+		// the bend axis is normal to the chain plane, a straight chain bends around the x axis of the middle joint
+		float nx = acy * abz - acz * aby;
+		float ny = acz * abx - acx * abz;
+		float nz = acx * aby - acy * abx;
+		float nLength = std::sqrt( nx * nx + ny * ny + nz * nz );
+		bool straight = nLength < 1e-3f * lac * lab;
+		float w = mqw[ i ], x = mqx[ i ], y = mqy[ i ], z = mqz[ i ];
+		float hx = 1.0f - 2.0f * ( y * y + z * z );
+		float hy = 2.0f * ( x * y + w * z );
+		float hz = 2.0f * ( x * z - w * y );
+		// made normal to the chain
+		float hDot = ( hx * acx + hy * acy + hz * acz ) / ( lac * lac );
+		nx = straight ? hx - hDot * acx : nx;
+		ny = straight ? hy - hDot * acy : ny;
+		nz = straight ? hz - hDot * acz : nz;
+		float nInv = 1.0f / std::max( std::sqrt( nx * nx + ny * ny + nz * nz ), MIN_LENGTH );
+		nx *= nInv;
+		ny *= nInv;
+		nz *= nInv;
+
+		// the swing axis turns the root to end line towards the target, a target opposite to
+		// the line has no such axis and swings half a turn around the bend axis, normal to the line
+		float sx = acy * atz - acz * aty;
+		float sy = acz * atx - acx * atz;
+		float sz = acx * aty - acy * atx;
+		float sLength = std::sqrt( sx * sx + sy * sy + sz * sz );
+		bool opposite = cosSwing < 0.0f && sLength < 1e-5f * lac * latRaw;
+		sx = opposite ? nx : sx;
+		sy = opposite ? ny : sy;
+		sz = opposite ? nz : sz;
+		float sInv = opposite ? 1.0f : 1.0f / std::max( sLength, MIN_LENGTH * MIN_LENGTH );
+
+		float r0c, r0s, r1c, r1s;
+		halfAngleDifference( cosRoot0, cosRoot1, r0c, r0s );
+		halfAngleDifference( cosMid0, cosMid1, r1c, r1s );
+		float r2c = std::sqrt( std::max( 0.5f * ( 1.0f + cosSwing ), 0.0f ) );
+		float r2s = std::sqrt( std::max( 0.5f * ( 1.0f - cosSwing ), 0.0f ) ) * sInv;
+
+		// world rotations of the root bone, swing after bend, and of the middle bone
+		float rootW, rootX, rootY, rootZ;
+		multiply( r2c, sx * r2s, sy * r2s, sz * r2s, r0c, nx * r0s, ny * r0s, nz * r0s, rootW, rootX, rootY, rootZ );
+		float midW, midX, midY, midZ;
+		multiply( rootW, rootX, rootY, rootZ, r1c, nx * r1s, ny * r1s, nz * r1s, midW, midX, midY, midZ );
+
+		bool on = enabled[ i ] > 0.5f;
+		rootW = on ? rootW : 1.0f;
+		rootX = on ? rootX : 0.0f;
+		rootY = on ? rootY : 0.0f;
+		rootZ = on ? rootZ : 0.0f;
+		midW = on ? midW : 1.0f;
+		midX = on ? midX : 0.0f;
+		midY = on ? midY : 0.0f;
+		midZ = on ? midZ : 0.0f;
+
+		float qw, qx, qy, qz;
+		multiply( rootW, rootX, rootY, rootZ, rqw[ i ], rqx[ i ], rqy[ i ], rqz[ i ], qw, qx, qy, qz );
+		rqw[ i ] = qw;
+		rqx[ i ] = qx;
+		rqy[ i ] = qy;
+		rqz[ i ] = qz;
+		multiply( midW, midX, midY, midZ, w, x, y, z, qw, qx, qy, qz );
+		mqw[ i ] = qw;
+		mqx[ i ] = qx;
+		mqy[ i ] = qy;
+		mqz[ i ] = qz;
+	}
+}
@@ -0,0 +1,57 @@
+#include <algorithm>
+#include <thread>
+
+#include "FrameScheduler.h"
+
+FrameScheduler::FrameScheduler()
+{
+	std::fill( mCosts, mCosts + NUM_COSTS, 0.0 );
+	mLastSwap = mLastFrameStart = mFrameStart = Clock::now();
+}
+
+void FrameScheduler::waitForFrame( const PoseBufferRef &poseBuffer )
+{
+	// with vertical sync the swap returned at the vertical blank
+	mLastSwap = Clock::now();
+
+	// sleep until a new pose arrives or the idle frame is due
+	auto idleDeadline = mLastFrameStart +
+		std::chrono::duration_cast< Clock::duration >( Seconds( mIdlePeriod ) );
+	poseBuffer->waitForPose( idleDeadline );
+
+	if ( mVerticalSync )
+	{
+		// start as late as possible before the next vertical blank
+		auto nextBlank = mLastSwap + std::chrono::duration_cast< Clock::duration >( Seconds( mRefreshPeriod ) );
+		Clock::time_point now = Clock::now();
+		while ( nextBlank < now )
+		{
+			nextBlank += std::chrono::duration_cast< Clock::duration >( Seconds( mRefreshPeriod ) );
+		}
+		auto latestStart = nextBlank -
+			std::chrono::duration_cast< Clock::duration >( Seconds( mPredictedCost + mMargin ) );
+		if ( latestStart > now )
+		{
+			std::this_thread::sleep_until( latestStart );
+		}
+	}
+
+	mFrameStart = mLastFrameStart = Clock::now();
+	mFrameStarted = true;
+}
+
+void FrameScheduler::endFrame( float gpuTime )
+{
+	// unpaced frames have no start, their cost would grow with the time since the last paced one
+	if ( ! mFrameStarted )
+	{
+		return;
+	}
+	mFrameStarted = false;
+
+	// the gpu renders the scene while the cpu submits the frame, the longer one decides the swap
+	double cost = std::max( Seconds( Clock::now() - mFrameStart ).count(), gpuTime * 0.001 );
+	mCosts[ mCostIndex ] = cost;
+	mCostIndex = ( mCostIndex + 1 ) % NUM_COSTS;
+	mPredictedCost = *std::max_element( mCosts, mCosts + NUM_COSTS );
+}
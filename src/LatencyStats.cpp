@@ -0,0 +1,204 @@
+#include <algorithm>
+#include <chrono>
+
+#include "LatencyStats.h"
+
+const double LatencyStats::Histogram::BIN_WIDTH_MS = 0.25;
+
+LatencyStats::Histogram::Histogram() :
+	mBins( NUM_BINS, 0 )
+{
+	reset();
+}
+
+void LatencyStats::Histogram::add( double ms )
+{
+	ms = std::max( ms, 0.0 );
+	size_t bin = static_cast< size_t >( ms / BIN_WIDTH_MS );
+	if ( bin < NUM_BINS )
+	{
+		mBins[ bin ]++;
+	}
+	else
+	{
+		mOverflow++;
+	}
+	mCount++;
+	mSum += ms;
+	mMax = std::max( mMax, ms );
+}
+
+void LatencyStats::Histogram::reset()
+{
+	std::fill( mBins.begin(), mBins.end(), 0 );
+	mOverflow = 0;
+	mCount = 0;
+	mSum = 0.0;
+	mMax = 0.0;
+}
+
+double LatencyStats::Histogram::getPercentile( double p ) const
+{
+	if ( mCount == 0 )
+	{
+		return 0.0;
+	}
+
+	size_t target = static_cast< size_t >( p * 0.01 * ( mCount - 1 ) ) + 1;
+	size_t count = 0;
+	for ( size_t i = 0; i < NUM_BINS; i++ )
+	{
+		count += mBins[ i ];
+		if ( count >= target )
+		{
+			return ( i + 0.5 ) * BIN_WIDTH_MS;
+		}
+	}
+	return mMax;
+}
+
+LatencyStats::LatencyStats()
+{
+}
+
+double LatencyStats::now()
+{
+	using namespace std::chrono;
+	return duration_cast< duration< double > >( system_clock::now().time_since_epoch() ).count();
+}
+
+void LatencyStats::markReceived( int32_t frameId, double senderTime /* = 0.0 */ )
+{
+	if ( frameId < 0 )
+	{
+		return;
+	}
+
+	std::lock_guard< std::mutex > lock( mReceivedMutex );
+	FrameTiming &timing = mReceived[ frameId % RECEIVED_HISTORY ];
+	// only the first message of a frame counts
+	if ( timing.mFrameId != frameId )
+	{
+		timing = FrameTiming();
+		timing.mFrameId = frameId;
+		timing.mSent = senderTime;
+		timing.mReceived = now();
+	}
+}
+
+void LatencyStats::markApplied( int32_t frameId )
+{
+	if ( frameId < 0 )
+	{
+		return;
+	}
+
+	std::lock_guard< std::mutex > lock( mReceivedMutex );
+	FrameTiming &timing = mReceived[ frameId % RECEIVED_HISTORY ];
+	if ( timing.mFrameId == frameId && timing.mApplied == 0.0 )
+	{
+		timing.mApplied = now();
+	}
+	mLatestApplied = frameId;
+}
+
+void LatencyStats::markUpdated()
+{
+	FrameTiming timing;
+	{
+		std::lock_guard< std::mutex > lock( mReceivedMutex );
+		if ( mLatestApplied < 0 )
+		{
+			return;
+		}
+		timing = mReceived[ mLatestApplied % RECEIVED_HISTORY ];
+	}
+
+	if ( timing.mFrameId < 0 || timing.mApplied == 0.0 ||
+		 ( mCurrentPending && timing.mFrameId == mCurrent.mFrameId ) ||
+		 ( ! mCurrentPending && timing.mFrameId == mLastDisplayed ) )
+	{
+		return;
+	}
+
+	if ( mCurrentPending )
+	{
+		// the previous frame has been replaced before it reached the screen
+		mSupersededFrames++;
+	}
+	mCurrent = timing;
+	mCurrent.mUpdated = now();
+	mCurrentPending = true;
+}
+
+void LatencyStats::markDrawn()
+{
+	if ( mCurrentPending && mCurrent.mDrawn == 0.0 )
+	{
+		mCurrent.mDrawn = now();
+	}
+}
+
+void LatencyStats::markSwapped()
+{
+	if ( ! mCurrentPending || mCurrent.mDrawn == 0.0 )
+	{
+		return;
+	}
+
+	double swapped = now();
+	const FrameTiming &t = mCurrent;
+	if ( t.mSent > 0.0 )
+	{
+		mHistograms[ SEND_TO_RECEIVE ].add( ( t.mReceived - t.mSent ) * 1000.0 );
+	}
+	mHistograms[ RECEIVE_TO_APPLY ].add( ( t.mApplied - t.mReceived ) * 1000.0 );
+	mHistograms[ APPLY_TO_UPDATE ].add( ( t.mUpdated - t.mApplied ) * 1000.0 );
+	mHistograms[ UPDATE_TO_DRAW ].add( ( t.mDrawn - t.mUpdated ) * 1000.0 );
+	mHistograms[ DRAW_TO_SWAP ].add( ( swapped - t.mDrawn ) * 1000.0 );
+	// without a sender timestamp the total starts at the receive time
+	double start = t.mSent > 0.0 ? t.mSent : t.mReceived;
+	mHistograms[ TOTAL ].add( ( swapped - start ) * 1000.0 );
+
+	mLastDisplayed = t.mFrameId;
+	mCurrentPending = false;
+}
+
+void LatencyStats::reset()
+{
+	for ( auto &h : mHistograms )
+	{
+		h.reset();
+	}
+	mSupersededFrames = 0;
+}
+
+const char * LatencyStats::getStageName( Stage stage )
+{
+	static const char *names[ NUM_STAGES ] =
+	{ "send_receive", "receive_apply", "apply_update", "update_draw", "draw_swap", "total" };
+	return names[ stage ];
+}
+
+void LatencyStats::writeCsvHeader( std::ostream &os ) const
+{
+	os << "time,frames,superseded";
+	for ( int i = 0; i < NUM_STAGES; i++ )
+	{
+		const char *name = getStageName( Stage( i ) );
+		os << "," << name << "_mean," << name << "_p50," << name << "_p95,"
+		   << name << "_p99," << name << "_max";
+	}
+	os << std::endl;
+}
+
+void LatencyStats::writeCsvRow( std::ostream &os ) const
+{
+	os << std::fixed << now() << "," << mHistograms[ TOTAL ].getCount() << "," << mSupersededFrames;
+	for ( const auto &h : mHistograms )
+	{
+		os << "," << h.getMean() << "," << h.getPercentile( 50.0 ) << "," << h.getPercentile( 95.0 )
+		   << "," << h.getPercentile( 99.0 ) << "," << h.getMax();
+	}
+	os << std::endl;
+}
@@ -0,0 +1,325 @@
+#include <algorithm>
+#include <cstddef>
+#include <sstream>
+
+#include "cinder/app/App.h"
+
+#include "MotionTrails.h"
+
+using namespace ci;
+
+// the ring buffer is indexed as ( slot * NUM_JOINTS + joint ) * 2, position then orientation
+static const char *sHistoryGlsl =
+	"uniform samplerBuffer uHistory;\n"
+	"uniform int uNumFrames;\n"
+	"uniform int uHead;\n"
+	"uniform mat4 uModelViewProjection;\n"
+	"uniform vec4 uColor;\n"
+	"out vec4 vColor;\n"
+	"\n"
+	"int historyTexel( int age, int joint )\n"
+	"{\n"
+	"	int slot = ( uHead - age % uNumFrames + uNumFrames ) % uNumFrames;\n"
+	"	return ( slot * NUM_JOINTS + joint ) * 2;\n"
+	"}\n"
+	"\n"
+	"vec3 rotate( vec4 q, vec3 v )\n"
+	"{\n"
+	"	return v + 2.0 * cross( q.xyz, cross( q.xyz, v ) + q.w * v );\n"
+	"}\n";
+
+// a segment of a ribbon per instance and joint, two triangles between two frames
+static const char *sTrailVert =
+	"uniform int uJoints[ NUM_JOINTS ];\n"
+	"uniform int uLength;\n"
+	"uniform float uWidth;\n"
+	"\n"
+	"const vec2 corners[ 6 ] = vec2[ 6 ]( vec2( 0.0, -1.0 ), vec2( 1.0, -1.0 ), vec2( 0.0, 1.0 ),\n"
+	"									  vec2( 0.0, 1.0 ), vec2( 1.0, -1.0 ), vec2( 1.0, 1.0 ) );\n"
+	"\n"
+	"void main()\n"
+	"{\n"
+	"	int joint = uJoints[ gl_VertexID / 6 ];\n"
+	"	vec2 corner = corners[ gl_VertexID % 6 ];\n"
+	"	int age = gl_InstanceID + int( corner.x );\n"
+	"	int texel = historyTexel( age, joint );\n"
+	"	vec3 position = texelFetch( uHistory, texel ).xyz;\n"
+	"	vec4 orientation = texelFetch( uHistory, texel + 1 );\n"
+	"	float fade = 1.0 - float( age ) / float( uLength );\n"
+	"	position += rotate( orientation, vec3( 0.5 * uWidth * fade * corner.y, 0.0, 0.0 ) );\n"
+	"	vColor = vec4( uColor.rgb, uColor.a * fade );\n"
+	"	gl_Position = uModelViewProjection * vec4( position, 1.0 );\n"
+	"}\n";
+
+// a skin per instance, the bones follow the joints of the frame of the instance
+static const char *sGhostVert =
+	"uniform samplerBuffer uBones;\n"
+	"uniform int uCount;\n"
+	"uniform int uSpacing;\n"
+	"in vec3 aPosition;\n"
+	"in vec4 aBones;\n"
+	"in vec4 aWeights;\n"
+	"\n"
+	"vec3 skin( int bone, int age )\n"
+	"{\n"
+	"	vec4 p = vec4( aPosition, 1.0 );\n"
+	"	vec3 local = vec3( dot( texelFetch( uBones, bone * 4 ), p ), dot( texelFetch( uBones, bone * 4 + 1 ), p ),\n"
+	"					   dot( texelFetch( uBones, bone * 4 + 2 ), p ) );\n"
+	"	int joint = int( texelFetch( uBones, bone * 4 + 3 ).x );\n"
+	"	if ( joint < 0 )\n"
+	"		return local;\n"
+	"	int texel = historyTexel( age, joint );\n"
+	"	return texelFetch( uHistory, texel ).xyz + rotate( texelFetch( uHistory, texel + 1 ), local );\n"
+	"}\n"
+	"\n"
+	"void main()\n"
+	"{\n"
+	"	int ghost = gl_InstanceID + 1;\n"
+	"	vec3 position = vec3( 0.0 );\n"
+	"	for ( int i = 0; i < 4; i++ )\n"
+	"	{\n"
+	"		if ( aWeights[ i ] > 0.0 )\n"
+	"			position += aWeights[ i ] * skin( int( aBones[ i ] ), ghost * uSpacing );\n"
+	"	}\n"
+	"	float fade = 1.0 - float( ghost ) / float( uCount + 1 );\n"
+	"	vColor = vec4( uColor.rgb, uColor.a * fade );\n"
+	"	gl_Position = uModelViewProjection * vec4( position, 1.0 );\n"
+	"}\n";
+
+static const char *sColorFrag =
+	"in vec4 vColor;\n"
+	"out vec4 oColor;\n"
+	"\n"
+	"void main()\n"
+	"{\n"
+	"	oColor = vColor;\n"
+	"}\n";
+
+MotionTrails::MotionTrails( size_t numFrames ) :
+	mNumFrames( std::max< size_t >( numFrames, 2 ) )
+{
+	mFrame.resize( Avatar::TOTAL_JOINTS * 2 );
+
+	glGenBuffers( 1, &mBuffer );
+	glBindBuffer( GL_TEXTURE_BUFFER, mBuffer );
+	glBufferData( GL_TEXTURE_BUFFER, mNumFrames * mFrame.size() * sizeof( Vec4f ), NULL, GL_DYNAMIC_DRAW );
+	glBindBuffer( GL_TEXTURE_BUFFER, 0 );
+
+	glGenTextures( 1, &mTexture );
+	glBindTexture( GL_TEXTURE_BUFFER, mTexture );
+	glTexBuffer( GL_TEXTURE_BUFFER, GL_RGBA32F, mBuffer );
+	glBindTexture( GL_TEXTURE_BUFFER, 0 );
+
+	setupShaders();
+}
+
+MotionTrails::~MotionTrails()
+{
+	glDeleteTextures( 1, &mTexture );
+	glDeleteBuffers( 1, &mBuffer );
+
+	if ( mSkinBuffer )
+	{
+		glDeleteTextures( 1, &mBoneTexture );
+		GLuint buffers[] = { mSkinBuffer, mSkinIndexBuffer, mBoneBuffer };
+		glDeleteBuffers( 3, buffers );
+	}
+}
+
+void MotionTrails::setupShaders()
+{
+	std::stringstream header;
+	header << "#version 140\n#define NUM_JOINTS " << Avatar::TOTAL_JOINTS << "\n";
+	std::string vertHeader = header.str() + sHistoryGlsl;
+	std::string frag = header.str() + sColorFrag;
+
+	try
+	{
+		mTrailShader = gl::GlslProg( ( vertHeader + sTrailVert ).c_str(), frag.c_str() );
+		mGhostShader = gl::GlslProg( ( vertHeader + sGhostVert ).c_str(), frag.c_str() );
+	}
+	catch ( const gl::GlslProgCompileExc &exc )
+	{
+		app::console() << "Error: motion trail shaders failed to compile: " << exc.what() << std::endl;
+		mTrailShader = gl::GlslProg();
+		mGhostShader = gl::GlslProg();
+	}
+}
+
+void MotionTrails::addFrame( const AvatarRef &avatar )
+{
+	avatar->getJointTransforms( mPositions, mOrientations );
+
+	for ( size_t i = 0; i < Avatar::TOTAL_JOINTS; i++ )
+	{
+		Vec3f &p = mPositions[ i ];
+		Quatf &q = mOrientations[ i ];
+		mFrame[ i * 2 ] = Vec4f( p.x, p.y, p.z, 1.0f );
+		mFrame[ i * 2 + 1 ] = Vec4f( q.v.x, q.v.y, q.v.z, q.w );
+	}
+
+	mHead = ( mHead + 1 ) % mNumFrames;
+	mNumValidFrames = std::min( mNumValidFrames + 1, mNumFrames );
+
+	size_t frameBytes = mFrame.size() * sizeof( Vec4f );
+	glBindBuffer( GL_TEXTURE_BUFFER, mBuffer );
+	glBufferSubData( GL_TEXTURE_BUFFER, mHead * frameBytes, frameBytes, &mFrame[ 0 ] );
+	glBindBuffer( GL_TEXTURE_BUFFER, 0 );
+}
+
+bool MotionTrails::uploadSkin( const Avatar::Skin &skin, size_t maxElements )
+{
+	if ( skin.mIndices.empty() )
+	{
+		return true;
+	}
+
+	typedef Avatar::Skin::Vertex Vertex;
+	if ( ! mSkinBuffer )
+	{
+		glGenBuffers( 1, &mSkinBuffer );
+		glBindBuffer( GL_ARRAY_BUFFER, mSkinBuffer );
+		glBufferData( GL_ARRAY_BUFFER, skin.mVertices.size() * sizeof( Vertex ), NULL, GL_STATIC_DRAW );
+		glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+		glGenBuffers( 1, &mSkinIndexBuffer );
+		glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, mSkinIndexBuffer );
+		glBufferData( GL_ELEMENT_ARRAY_BUFFER, skin.mIndices.size() * sizeof( uint32_t ), NULL, GL_STATIC_DRAW );
+		glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+
+		// a few texels per bone, small enough to go at once
+		glGenBuffers( 1, &mBoneBuffer );
+		glBindBuffer( GL_TEXTURE_BUFFER, mBoneBuffer );
+		glBufferData( GL_TEXTURE_BUFFER, skin.mBones.size() * sizeof( Vec4f ), &skin.mBones[ 0 ], GL_STATIC_DRAW );
+		glBindBuffer( GL_TEXTURE_BUFFER, 0 );
+
+		glGenTextures( 1, &mBoneTexture );
+		glBindTexture( GL_TEXTURE_BUFFER, mBoneTexture );
+		glTexBuffer( GL_TEXTURE_BUFFER, GL_RGBA32F, mBoneBuffer );
+		glBindTexture( GL_TEXTURE_BUFFER, 0 );
+	}
+
+	size_t numVertices = skin.mVertices.size();
+	size_t total = numVertices + skin.mIndices.size();
+	size_t end = std::min( mSkinUploaded + std::max< size_t >( maxElements, 1 ), total );
+	if ( mSkinUploaded < numVertices )
+	{
+		size_t last = std::min( end, numVertices );
+		glBindBuffer( GL_ARRAY_BUFFER, mSkinBuffer );
+		glBufferSubData( GL_ARRAY_BUFFER, mSkinUploaded * sizeof( Vertex ), ( last - mSkinUploaded ) * sizeof( Vertex ),
+						 &skin.mVertices[ mSkinUploaded ] );
+		glBindBuffer( GL_ARRAY_BUFFER, 0 );
+	}
+	if ( end > numVertices )
+	{
+		size_t first = std::max( mSkinUploaded, numVertices ) - numVertices;
+		glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, mSkinIndexBuffer );
+		glBufferSubData( GL_ELEMENT_ARRAY_BUFFER, first * sizeof( uint32_t ), ( end - numVertices - first ) * sizeof( uint32_t ),
+						 &skin.mIndices[ first ] );
+		glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+	}
+	mSkinUploaded = end;
+
+	if ( mSkinUploaded < total )
+	{
+		return false;
+	}
+	mNumSkinIndices = skin.mIndices.size();
+	return true;
+}
+
+void MotionTrails::drawTrails( const std::vector< size_t > &joints, size_t length, float width, const ColorA &color )
+{
+	size_t numSegments = std::min( length, mNumValidFrames - std::min< size_t >( mNumValidFrames, 1 ) );
+	if ( ! mTrailShader || joints.empty() || numSegments == 0 )
+	{
+		return;
+	}
+
+	int jointIds[ Avatar::TOTAL_JOINTS ];
+	size_t numJoints = std::min< size_t >( joints.size(), Avatar::TOTAL_JOINTS );
+	for ( size_t i = 0; i < numJoints; i++ )
+	{
+		jointIds[ i ] = static_cast< int >( std::min< size_t >( joints[ i ], Avatar::TOTAL_JOINTS - 1 ) );
+	}
+
+	beginDraw( mTrailShader, color );
+	mTrailShader.uniform( "uJoints", jointIds, static_cast< int >( numJoints ) );
+	mTrailShader.uniform( "uLength", static_cast< int >( numSegments ) );
+	mTrailShader.uniform( "uWidth", width );
+	glDrawArraysInstanced( GL_TRIANGLES, 0, static_cast< GLsizei >( numJoints * 6 ),
+						   static_cast< GLsizei >( numSegments ) );
+	endDraw();
+}
+
+void MotionTrails::drawGhosts( size_t count, size_t spacing, const ColorA &color )
+{
+	spacing = std::max< size_t >( spacing, 1 );
+	count = std::min( count, ( mNumValidFrames - std::min< size_t >( mNumValidFrames, 1 ) ) / spacing );
+	if ( ! mGhostShader || mNumSkinIndices == 0 || count == 0 )
+	{
+		return;
+	}
+
+	beginDraw( mGhostShader, color );
+	glActiveTexture( GL_TEXTURE1 );
+	glBindTexture( GL_TEXTURE_BUFFER, mBoneTexture );
+	glActiveTexture( GL_TEXTURE0 );
+	mGhostShader.uniform( "uBones", 1 );
+	mGhostShader.uniform( "uCount", static_cast< int >( count ) );
+	mGhostShader.uniform( "uSpacing", static_cast< int >( spacing ) );
+
+	typedef Avatar::Skin::Vertex Vertex;
+	GLint position = mGhostShader.getAttribLocation( "aPosition" );
+	GLint bones = mGhostShader.getAttribLocation( "aBones" );
+	GLint weights = mGhostShader.getAttribLocation( "aWeights" );
+	glBindBuffer( GL_ARRAY_BUFFER, mSkinBuffer );
+	glEnableVertexAttribArray( position );
+	glVertexAttribPointer( position, 3, GL_FLOAT, GL_FALSE, sizeof( Vertex ),
+						   reinterpret_cast< const GLvoid * >( offsetof( Vertex, mPosition ) ) );
+	glEnableVertexAttribArray( bones );
+	glVertexAttribPointer( bones, 4, GL_FLOAT, GL_FALSE, sizeof( Vertex ),
+						   reinterpret_cast< const GLvoid * >( offsetof( Vertex, mBones ) ) );
+	glEnableVertexAttribArray( weights );
+	glVertexAttribPointer( weights, 4, GL_FLOAT, GL_FALSE, sizeof( Vertex ),
+						   reinterpret_cast< const GLvoid * >( offsetof( Vertex, mWeights ) ) );
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, mSkinIndexBuffer );
+
+	glDrawElementsInstanced( GL_TRIANGLES, static_cast< GLsizei >( mNumSkinIndices ), GL_UNSIGNED_INT, 0,
+							 static_cast< GLsizei >( count ) );
+
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+	glDisableVertexAttribArray( position );
+	glDisableVertexAttribArray( bones );
+	glDisableVertexAttribArray( weights );
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+	glActiveTexture( GL_TEXTURE1 );
+	glBindTexture( GL_TEXTURE_BUFFER, 0 );
+	glActiveTexture( GL_TEXTURE0 );
+	endDraw();
+}
+
+void MotionTrails::beginDraw( gl::GlslProg &shader, const ColorA &color )
+{
+	// the shaders read the joints from the history by the instance ids
+	shader.bind();
+	glActiveTexture( GL_TEXTURE0 );
+	glBindTexture( GL_TEXTURE_BUFFER, mTexture );
+	shader.uniform( "uHistory", 0 );
+	shader.uniform( "uNumFrames", static_cast< int >( mNumFrames ) );
+	shader.uniform( "uHead", static_cast< int >( mHead ) );
+	shader.uniform( "uModelViewProjection", gl::getProjection() * gl::getModelView() );
+	shader.uniform( "uColor", color );
+
+	gl::enableAlphaBlending();
+	gl::disableDepthWrite();
+}
+
+void MotionTrails::endDraw()
+{
+	gl::enableDepthWrite();
+	gl::disableAlphaBlending();
+
+	glBindTexture( GL_TEXTURE_BUFFER, 0 );
+	gl::GlslProg::unbind();
+}
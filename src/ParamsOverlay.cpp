@@ -0,0 +1,131 @@
+#include "cinder/gl/gl.h"
+
+#include "ParamsOverlay.h"
+#include "ParamsUtils.h"
+
+using namespace ci;
+using namespace ci::app;
+
+static const char *sCompositeVert =
+	"#version 120\n"
+	"void main()\n"
+	"{\n"
+	"	gl_TexCoord[ 0 ] = gl_MultiTexCoord0;\n"
+	"	gl_Position = ftransform();\n"
+	"}\n";
+
+// the bars over black are premultiplied, the difference over white is what shows through
+static const char *sCompositeFrag =
+	"#version 120\n"
+	"uniform sampler2D uOverBlack;\n"
+	"uniform sampler2D uOverWhite;\n"
+	"\n"
+	"void main()\n"
+	"{\n"
+	"	vec3 overBlack = texture2D( uOverBlack, gl_TexCoord[ 0 ].st ).rgb;\n"
+	"	vec3 overWhite = texture2D( uOverWhite, gl_TexCoord[ 0 ].st ).rgb;\n"
+	"	float transmittance = dot( overWhite - overBlack, vec3( 1.0 / 3.0 ) );\n"
+	"	gl_FragColor = vec4( overBlack, clamp( 1.0 - transmittance, 0.0, 1.0 ) );\n"
+	"}\n";
+
+ParamsOverlay::ParamsOverlay( const params::InterfaceGlRef &params ) :
+	mParams( params )
+{
+	try
+	{
+		mCompositeShader = gl::GlslProg( sCompositeVert, sCompositeFrag );
+	}
+	catch ( const gl::GlslProgCompileExc &exc )
+	{
+		// the params are drawn directly
+		console() << "Error: params composite shader failed to compile: " << exc.what() << std::endl;
+	}
+
+	// any input can change a value or the layout through the bars
+	WindowRef window = getWindow();
+	auto invalidateMouse = [ this ]( MouseEvent & ) { invalidate(); };
+	mConnections.push_back( window->getSignalMouseDown().connect( invalidateMouse ) );
+	mConnections.push_back( window->getSignalMouseUp().connect( invalidateMouse ) );
+	mConnections.push_back( window->getSignalMouseMove().connect( invalidateMouse ) );
+	mConnections.push_back( window->getSignalMouseDrag().connect( invalidateMouse ) );
+	mConnections.push_back( window->getSignalMouseWheel().connect( invalidateMouse ) );
+	mConnections.push_back( window->getSignalKeyDown().connect( [ this ]( KeyEvent & ) { invalidate(); } ) );
+	mConnections.push_back( window->getSignalResize().connect( [ this ]() { invalidate(); } ) );
+}
+
+ParamsOverlay::~ParamsOverlay()
+{
+	for ( auto &connection : mConnections )
+	{
+		connection.disconnect();
+	}
+}
+
+void ParamsOverlay::draw()
+{
+	if ( ! mCacheEnabled || ! mCompositeShader )
+	{
+		mParams->draw();
+		return;
+	}
+
+	Vec2i windowSize = getWindowSize();
+	double time = getElapsedSeconds();
+	size_t layoutHash = mndl::params::getParamsLayoutHash();
+	if ( mDirty || ! mFbo || mFbo.getSize() != windowSize || layoutHash != mLayoutHash ||
+		 time - mLastRenderTime >= mRefreshInterval )
+	{
+		render( windowSize );
+		mLayoutHash = layoutHash;
+		mLastRenderTime = time;
+		mDirty = false;
+	}
+
+	gl::setViewport( Area( Vec2i::zero(), windowSize ) );
+	gl::setMatricesWindow( windowSize );
+	gl::disableDepthRead();
+	gl::disableDepthWrite();
+	gl::enable( GL_BLEND );
+	glBlendFunc( GL_ONE, GL_ONE_MINUS_SRC_ALPHA );
+	gl::color( Color::white() );
+	mCompositeShader.bind();
+	mCompositeShader.uniform( "uOverBlack", 0 );
+	mCompositeShader.uniform( "uOverWhite", 1 );
+	mFbo.getTexture( 1 ).bind( 1 );
+	gl::draw( mFbo.getTexture( 0 ), Rectf( Vec2f::zero(), Vec2f( windowSize ) ) );
+	mFbo.getTexture( 1 ).unbind( 1 );
+	mCompositeShader.unbind();
+	gl::disableAlphaBlending();
+}
+
+void ParamsOverlay::invalidate()
+{
+	mDirty = true;
+	// input may have moved or resized a bar
+	mndl::params::invalidateParamsLayoutHash();
+}
+
+void ParamsOverlay::render( const Vec2i &windowSize )
+{
+	if ( ! mFbo || mFbo.getSize() != windowSize )
+	{
+		gl::Fbo::Format format;
+		format.setColorInternalFormat( GL_RGBA8 );
+		format.enableColorBuffer( true, 2 );
+		mFbo = gl::Fbo( std::max( windowSize.x, 1 ), std::max( windowSize.y, 1 ), format );
+	}
+
+	// AntTweakBar blends the alpha with GL_SRC_ALPHA as well, which leaves the square of the coverage in
+	// the alpha channel. The bars are drawn over black and over white at once instead, the composite
+	// takes the premultiplied color from the first buffer and the coverage from the difference.
+	mFbo.bindFramebuffer();
+	gl::setViewport( mFbo.getBounds() );
+	glDrawBuffer( GL_COLOR_ATTACHMENT0 );
+	gl::clear( ColorA( 0.0f, 0.0f, 0.0f, 0.0f ) );
+	glDrawBuffer( GL_COLOR_ATTACHMENT1 );
+	gl::clear( ColorA( 1.0f, 1.0f, 1.0f, 0.0f ) );
+	const GLenum drawBuffers[ 2 ] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers( 2, drawBuffers );
+	mParams->draw();
+	mFbo.unbindFramebuffer();
+}
@@ -1,3 +1,4 @@
+#include <functional>
 #include <map>
 #include <string>
 #include <unordered_map>
@@ -10,6 +11,9 @@
 
 namespace mndl { namespace params {
 
+size_t sLayoutHash = 0;
+bool sLayoutHashValid = false;
+
 void showAllParams( bool visible, bool alwaysHideHelp /* = true */ )
 {
 	int windowId = 0;
@@ -31,6 +35,8 @@ void showAllParams( bool visible, bool alwaysHideHelp /* = true */ )
 
 	if ( alwaysHideHelp )
 		TwDefine( "TW_HELP visible=false" );
+
+	invalidateParamsLayoutHash();
 }
 
 struct BarInfo
@@ -90,6 +96,8 @@ void readParamsLayout()
 		TwSetParam( bar, NULL, "valueswidth", TW_PARAM_INT32, 1, &bi->mValuesWidth );
 		TwSetParam( bar, NULL, "iconified", TW_PARAM_INT32, 1, &bi->mIconified );
 	}
+
+	invalidateParamsLayoutHash();
 }
 
 // call this *before* config->write()
@@ -106,4 +114,52 @@ void writeParamsLayout()
 	}
 }
 
+void invalidateParamsLayoutHash()
+{
+	sLayoutHashValid = false;
+}
+
+size_t getParamsLayoutHash()
+{
+	if ( sLayoutHashValid )
+	{
+		return sLayoutHash;
+	}
+
+	size_t hash = 0;
+	auto combine = [ &hash ]( int32_t value )
+	{
+		hash ^= std::hash< int32_t >()( value ) + 0x9e3779b9 + ( hash << 6 ) + ( hash >> 2 );
+	};
+
+	int windowId = 0;
+	while ( TwWindowExists( windowId ) )
+	{
+		TwSetCurrentWindow( windowId );
+		int barCount = TwGetBarCount();
+		combine( barCount );
+
+		for ( int i = 0; i < barCount; ++i )
+		{
+			TwBar *bar = TwGetBarByIndex( i );
+			int32_t values[ 7 ];
+			TwGetParam( bar, NULL, "visible", TW_PARAM_INT32, 1, &values[ 0 ] );
+			TwGetParam( bar, NULL, "size", TW_PARAM_INT32, 2, &values[ 1 ] );
+			TwGetParam( bar, NULL, "position", TW_PARAM_INT32, 2, &values[ 3 ] );
+			TwGetParam( bar, NULL, "valueswidth", TW_PARAM_INT32, 1, &values[ 5 ] );
+			TwGetParam( bar, NULL, "iconified", TW_PARAM_INT32, 1, &values[ 6 ] );
+			for ( int32_t v : values )
+			{
+				combine( v );
+			}
+		}
+
+		windowId++;
+	}
+
+	sLayoutHash = hash;
+	sLayoutHashValid = true;
+	return hash;
+}
+
 } } // namespace mndl::params
@@ -0,0 +1,156 @@
+#include "PoseBuffer.h"
+
+using namespace ci;
+
+// frame ids this far behind the current one mean that the sender restarted
+static const int32_t FRAME_ID_RESTART_THRESHOLD = 1000;
+
+void PoseBuffer::setPosition( int32_t frameId, size_t jointId, const Vec3f &position )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	if ( ! beginMessage( frameId, jointId ) )
+	{
+		return;
+	}
+
+	mIncoming.mPositions[ jointId ] = position;
+	mIncoming.mPositionMask.set( jointId );
+	if ( mIncoming.mOrientationMask.all() )
+	{
+		publish();
+	}
+}
+
+void PoseBuffer::setOrientation( int32_t frameId, size_t jointId, const Vec3f &eulerDegrees )
+{
+	setOrientation( frameId, jointId, Avatar::eulerToQuat( eulerDegrees ) );
+}
+
+void PoseBuffer::setOrientation( int32_t frameId, size_t jointId, const Quatf &orientation )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	if ( ! beginMessage( frameId, jointId ) )
+	{
+		return;
+	}
+
+	mIncoming.mOrientations[ jointId ] = orientation;
+	mIncoming.mOrientationMask.set( jointId );
+	if ( mIncoming.mOrientationMask.all() )
+	{
+		publish();
+	}
+}
+
+void PoseBuffer::setPose( const Pose &pose )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	if ( ! beginMessage( pose.mFrameId, 0 ) )
+	{
+		return;
+	}
+
+	mIncoming = pose;
+	if ( pose.mOrientationMask.all() )
+	{
+		publish();
+	}
+	else
+	{
+		mIncompleteFrames++;
+	}
+}
+
+bool PoseBuffer::getLatestPose( Pose *pose )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	if ( ! mLatestChanged )
+	{
+		return false;
+	}
+
+	*pose = mLatest;
+	mLatestChanged = false;
+	return true;
+}
+
+bool PoseBuffer::takeLatestFrameId( int32_t *frameId )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	if ( ! mLatestChanged )
+	{
+		return false;
+	}
+
+	*frameId = mLatest.mFrameId;
+	mLatestChanged = false;
+	return true;
+}
+
+bool PoseBuffer::getPose( int32_t frameId, Pose *pose )
+{
+	if ( frameId < 0 )
+	{
+		return false;
+	}
+
+	std::lock_guard< std::mutex > lock( mMutex );
+	const Pose &p = mHistory[ frameId % HISTORY_SIZE ];
+	if ( p.mFrameId != frameId )
+	{
+		return false;
+	}
+
+	*pose = p;
+	return true;
+}
+
+bool PoseBuffer::waitForPose( const std::chrono::steady_clock::time_point &deadline )
+{
+	std::unique_lock< std::mutex > lock( mMutex );
+	return mPoseCondition.wait_until( lock, deadline, [ this ] { return mLatestChanged; } );
+}
+
+bool PoseBuffer::beginMessage( int32_t frameId, size_t jointId )
+{
+	if ( jointId >= Avatar::TOTAL_JOINTS || frameId < 0 )
+	{
+		mInvalidMessages++;
+		mDroppedMessages++;
+		return false;
+	}
+
+	if ( frameId == mIncoming.mFrameId )
+	{
+		return true;
+	}
+
+	if ( frameId < mIncoming.mFrameId )
+	{
+		if ( mIncoming.mFrameId - frameId < FRAME_ID_RESTART_THRESHOLD )
+		{
+			// late message of a frame that has been superseded already
+			mDroppedMessages++;
+			return false;
+		}
+		mRestarts++;
+	}
+
+	// a new frame starts, the previous one is dropped if it is still incomplete,
+	// the avatar would keep the missing joints of an older frame
+	if ( mIncoming.mFrameId >= 0 && ! mIncoming.mOrientationMask.all() )
+	{
+		mIncompleteFrames++;
+	}
+	mIncoming.clear();
+	mIncoming.mFrameId = frameId;
+	return true;
+}
+
+void PoseBuffer::publish()
+{
+	mLatest = mIncoming;
+	mLatestChanged = true;
+	mHistory[ mLatest.mFrameId % HISTORY_SIZE ] = mLatest;
+	mPoseCondition.notify_all();
+}
@@ -0,0 +1,257 @@
+#include <cmath>
+#include <cstring>
+
+#include "PoseCodec.h"
+
+using namespace ci;
+
+// the three smallest components of a unit quaternion are within +-1/sqrt(2)
+static const float QUAT_COMPONENT_RANGE = 0.70710678f;
+static const uint32_t QUAT_COMPONENT_MAX = 1023;
+
+static void writeInt32( uint8_t *dst, int32_t value )
+{
+	uint32_t v = static_cast< uint32_t >( value );
+	dst[ 0 ] = v & 0xff;
+	dst[ 1 ] = ( v >> 8 ) & 0xff;
+	dst[ 2 ] = ( v >> 16 ) & 0xff;
+	dst[ 3 ] = ( v >> 24 ) & 0xff;
+}
+
+static int32_t readInt32( const uint8_t *src )
+{
+	return static_cast< int32_t >( src[ 0 ] | ( src[ 1 ] << 8 ) | ( src[ 2 ] << 16 ) |
+								   ( static_cast< uint32_t >( src[ 3 ] ) << 24 ) );
+}
+
+static void writeFloat( uint8_t *dst, float value )
+{
+	int32_t v;
+	std::memcpy( &v, &value, 4 );
+	writeInt32( dst, v );
+}
+
+static float readFloat( const uint8_t *src )
+{
+	int32_t v = readInt32( src );
+	float value;
+	std::memcpy( &value, &v, 4 );
+	return value;
+}
+
+namespace PoseCodec
+{
+
+uint32_t packQuat( const Quatf &q )
+{
+	float c[ 4 ] = { q.v.x, q.v.y, q.v.z, q.w };
+	uint32_t largest = 0;
+	for ( uint32_t i = 1; i < 4; i++ )
+	{
+		if ( std::abs( c[ i ] ) > std::abs( c[ largest ] ) )
+		{
+			largest = i;
+		}
+	}
+
+	// q and -q are the same rotation, the largest component is sent as positive
+	float sign = c[ largest ] < 0.0f ? -1.0f : 1.0f;
+	uint32_t packed = largest << 30;
+	int shift = 20;
+	for ( uint32_t i = 0; i < 4; i++ )
+	{
+		if ( i == largest )
+		{
+			continue;
+		}
+		float v = ( c[ i ] * sign + QUAT_COMPONENT_RANGE ) / ( 2.0f * QUAT_COMPONENT_RANGE );
+		float quantized = std::floor( v * QUAT_COMPONENT_MAX + 0.5f );
+		uint32_t bits = static_cast< uint32_t >( std::min( std::max( quantized, 0.0f ), float( QUAT_COMPONENT_MAX ) ) );
+		packed |= bits << shift;
+		shift -= 10;
+	}
+	return packed;
+}
+
+Quatf unpackQuat( uint32_t packed )
+{
+	uint32_t largest = packed >> 30;
+	float c[ 4 ];
+	float sumSq = 0.0f;
+	int shift = 20;
+	for ( uint32_t i = 0; i < 4; i++ )
+	{
+		if ( i == largest )
+		{
+			continue;
+		}
+		uint32_t bits = ( packed >> shift ) & QUAT_COMPONENT_MAX;
+		c[ i ] = ( bits / float( QUAT_COMPONENT_MAX ) ) * 2.0f * QUAT_COMPONENT_RANGE - QUAT_COMPONENT_RANGE;
+		sumSq += c[ i ] * c[ i ];
+		shift -= 10;
+	}
+	c[ largest ] = std::sqrt( std::max( 1.0f - sumSq, 0.0f ) );
+
+	Quatf q( c[ 3 ], c[ 0 ], c[ 1 ], c[ 2 ] );
+	q.normalize();
+	return q;
+}
+
+} // namespace PoseCodec
+
+void PoseEncoder::encode( const Pose &pose, std::vector< uint8_t > *data )
+{
+	uint32_t orientations[ Avatar::TOTAL_JOINTS ];
+	for ( size_t i = 0; i < Avatar::TOTAL_JOINTS; i++ )
+	{
+		orientations[ i ] = pose.mOrientationMask[ i ] ? PoseCodec::packQuat( pose.mOrientations[ i ] ) : 0;
+	}
+	bool hasRootPosition = pose.mPositionMask[ Avatar::HIP ];
+	const Vec3f &rootPosition = pose.mPositions[ Avatar::HIP ];
+
+	// a delta can only update the joints of the keyframe
+	bool keyframe = mFramesSinceKeyframe < 0 ||
+					mFramesSinceKeyframe + 1 >= mKeyframeInterval ||
+					( pose.mOrientationMask & ~mKeyOrientationMask ).any() ||
+					( hasRootPosition && ! mKeyHasRootPosition );
+
+	std::bitset< Avatar::TOTAL_JOINTS > changed;
+	bool sendRootPosition = hasRootPosition;
+	if ( keyframe )
+	{
+		changed = pose.mOrientationMask;
+		mFramesSinceKeyframe = 0;
+		mKeyframeId = pose.mFrameId;
+		mKeyOrientationMask = pose.mOrientationMask;
+		std::memcpy( mKeyOrientations, orientations, sizeof( orientations ) );
+		mKeyHasRootPosition = hasRootPosition;
+		mKeyRootPosition = rootPosition;
+	}
+	else
+	{
+		for ( size_t i = 0; i < Avatar::TOTAL_JOINTS; i++ )
+		{
+			changed[ i ] = pose.mOrientationMask[ i ] && orientations[ i ] != mKeyOrientations[ i ];
+		}
+		sendRootPosition = hasRootPosition && rootPosition != mKeyRootPosition;
+		mFramesSinceKeyframe++;
+	}
+
+	data->resize( PoseCodec::MAX_SIZE );
+	uint8_t *dst = data->data();
+	dst[ 0 ] = ( keyframe ? PoseCodec::FLAG_KEYFRAME : 0 ) | ( sendRootPosition ? PoseCodec::FLAG_ROOT_POSITION : 0 );
+	dst[ 1 ] = Avatar::TOTAL_JOINTS;
+	writeInt32( dst + 2, pose.mFrameId );
+	writeInt32( dst + 6, mKeyframeId );
+	dst += PoseCodec::HEADER_SIZE;
+
+	std::memset( dst, 0, PoseCodec::MASK_SIZE );
+	for ( size_t i = 0; i < Avatar::TOTAL_JOINTS; i++ )
+	{
+		dst[ i >> 3 ] |= changed[ i ] << ( i & 7 );
+	}
+	dst += PoseCodec::MASK_SIZE;
+
+	if ( sendRootPosition )
+	{
+		writeFloat( dst, rootPosition.x );
+		writeFloat( dst + 4, rootPosition.y );
+		writeFloat( dst + 8, rootPosition.z );
+		dst += 12;
+	}
+
+	for ( size_t i = 0; i < Avatar::TOTAL_JOINTS; i++ )
+	{
+		if ( changed[ i ] )
+		{
+			writeInt32( dst, static_cast< int32_t >( orientations[ i ] ) );
+			dst += 4;
+		}
+	}
+
+	data->resize( dst - data->data() );
+}
+
+bool PoseDecoder::decode( const uint8_t *data, size_t size, Pose *pose )
+{
+	if ( size < PoseCodec::HEADER_SIZE || data[ 1 ] != Avatar::TOTAL_JOINTS ||
+		 size < PoseCodec::HEADER_SIZE + PoseCodec::MASK_SIZE )
+	{
+		return false;
+	}
+
+	uint8_t flags = data[ 0 ];
+	bool keyframe = ( flags & PoseCodec::FLAG_KEYFRAME ) != 0;
+	int32_t frameId = readInt32( data + 2 );
+	int32_t keyframeId = readInt32( data + 6 );
+	if ( ! keyframe && keyframeId != mKeyframeId )
+	{
+		mMissingKeyframes++;
+		return false;
+	}
+
+	const uint8_t *src = data + PoseCodec::HEADER_SIZE;
+	const uint8_t *end = data + size;
+	std::bitset< Avatar::TOTAL_JOINTS > changed;
+	for ( size_t i = 0; i < Avatar::TOTAL_JOINTS; i++ )
+	{
+		changed[ i ] = ( src[ i >> 3 ] >> ( i & 7 ) ) & 1;
+	}
+	src += PoseCodec::MASK_SIZE;
+
+	size_t expectedSize = ( ( flags & PoseCodec::FLAG_ROOT_POSITION ) ? 12 : 0 ) + changed.count() * 4;
+	if ( static_cast< size_t >( end - src ) != expectedSize )
+	{
+		return false;
+	}
+
+	pose->clear();
+	pose->mFrameId = frameId;
+	if ( keyframe )
+	{
+		mKeyframeId = frameId;
+		mKeyOrientationMask.reset();
+		mKeyHasRootPosition = false;
+	}
+	else
+	{
+		pose->mOrientationMask = mKeyOrientationMask;
+		std::copy( mKeyOrientations, mKeyOrientations + Avatar::TOTAL_JOINTS, pose->mOrientations );
+	}
+
+	if ( flags & PoseCodec::FLAG_ROOT_POSITION )
+	{
+		Vec3f p( readFloat( src ), readFloat( src + 4 ), readFloat( src + 8 ) );
+		src += 12;
+		if ( keyframe )
+		{
+			mKeyHasRootPosition = true;
+			mKeyRootPosition = p;
+		}
+		pose->mPositions[ Avatar::HIP ] = p;
+		pose->mPositionMask.set( Avatar::HIP );
+	}
+	else if ( mKeyHasRootPosition )
+	{
+		pose->mPositions[ Avatar::HIP ] = mKeyRootPosition;
+		pose->mPositionMask.set( Avatar::HIP );
+	}
+
+	for ( size_t i = 0; i < Avatar::TOTAL_JOINTS; i++ )
+	{
+		if ( changed[ i ] )
+		{
+			Quatf q = PoseCodec::unpackQuat( static_cast< uint32_t >( readInt32( src ) ) );
+			src += 4;
+			pose->mOrientations[ i ] = q;
+			pose->mOrientationMask.set( i );
+			if ( keyframe )
+			{
+				mKeyOrientations[ i ] = q;
+				mKeyOrientationMask.set( i );
+			}
+		}
+	}
+
+	return true;
+}
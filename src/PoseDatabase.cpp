@@ -0,0 +1,380 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+#include "cinder/app/App.h"
+
+#include "PoseDatabase.h"
+
+using namespace ci;
+
+static const char SESSION_MAGIC[ 4 ] = { 'A', 'I', 'P', 'S' };
+static const uint32_t SESSION_VERSION = 1;
+static const size_t SESSION_HEADER_SIZE = 20;
+
+// sessions are little endian on any host, the shifts compile to plain loads and stores on little endian ones
+static uint32_t readUint32( const uint8_t *data )
+{
+	return uint32_t( data[ 0 ] ) | ( uint32_t( data[ 1 ] ) << 8 ) |
+		   ( uint32_t( data[ 2 ] ) << 16 ) | ( uint32_t( data[ 3 ] ) << 24 );
+}
+
+static float readFloat( const uint8_t *data )
+{
+	uint32_t bits = readUint32( data );
+	float value;
+	std::memcpy( &value, &bits, sizeof( value ) );
+	return value;
+}
+
+static void writeUint32( uint8_t *data, uint32_t value )
+{
+	data[ 0 ] = static_cast< uint8_t >( value );
+	data[ 1 ] = static_cast< uint8_t >( value >> 8 );
+	data[ 2 ] = static_cast< uint8_t >( value >> 16 );
+	data[ 3 ] = static_cast< uint8_t >( value >> 24 );
+}
+
+static void writeFloat( uint8_t *data, float value )
+{
+	uint32_t bits;
+	std::memcpy( &bits, &value, sizeof( bits ) );
+	writeUint32( data, bits );
+}
+
+bool PoseDatabase::addSession( const DataSourceRef &source )
+{
+	const Buffer &buffer = source->getBuffer();
+	const uint8_t *data = static_cast< const uint8_t * >( buffer.getData() );
+	size_t size = buffer.getDataSize();
+
+	uint32_t header[ 3 ];
+	float rate;
+	if ( size >= SESSION_HEADER_SIZE )
+	{
+		for ( size_t i = 0; i < 3; i++ )
+		{
+			header[ i ] = readUint32( data + 4 + i * 4 );
+		}
+		rate = readFloat( data + 16 );
+	}
+	if ( size < SESSION_HEADER_SIZE || std::memcmp( data, SESSION_MAGIC, 4 ) != 0 ||
+		 header[ 0 ] != SESSION_VERSION || header[ 1 ] != N ||
+		 size != SESSION_HEADER_SIZE + size_t( header[ 2 ] ) * N * 4 * sizeof( float ) )
+	{
+		app::console() << "Warning: invalid pose session " << source->getFilePathHint() << std::endl;
+		return false;
+	}
+
+	// straight into the features, a decoded copy of millions of frames would double the memory
+	size_t numFrames = header[ 2 ];
+	const uint8_t *orientations = data + SESSION_HEADER_SIZE;
+	size_t firstFrame = beginSession( numFrames, rate );
+	for ( size_t f = 0; f < numFrames; f++ )
+	{
+		float *feature = getFeature( firstFrame + f );
+		for ( size_t i = 0; i < N; i++ )
+		{
+			const uint8_t *q = orientations + ( f * N + i ) * 4 * sizeof( float );
+			setFeatureJoint( i, Quatf( readFloat( q + 12 ), readFloat( q ), readFloat( q + 4 ), readFloat( q + 8 ) ), feature );
+		}
+		std::fill( feature + 4 * N, feature + FEATURE_SIZE, 0.0f );
+	}
+	return true;
+}
+
+void PoseDatabase::addSession( const std::vector< Pose > &poses, float rate )
+{
+	size_t firstFrame = beginSession( poses.size(), rate );
+	for ( size_t f = 0; f < poses.size(); f++ )
+	{
+		poseToFeature( poses[ f ], getFeature( firstFrame + f ) );
+	}
+}
+
+size_t PoseDatabase::beginSession( size_t numFrames, float rate )
+{
+	size_t firstFrame = mNumFrames;
+	if ( numFrames == 0 )
+	{
+		return firstFrame;
+	}
+
+	Session session;
+	session.mFirstFrame = firstFrame;
+	session.mNumFrames = numFrames;
+	session.mRate = std::max( rate, 1.0f );
+	mSessions.push_back( session );
+
+	mNumFrames += numFrames;
+	mFeatures.resize( mNumFrames * FEATURE_SIZE );
+	mFrameSessions.resize( mNumFrames, static_cast< uint32_t >( mSessions.size() - 1 ) );
+	return firstFrame;
+}
+
+bool PoseDatabase::writeSession( const fs::path &path, const std::vector< Pose > &poses, float rate )
+{
+	SessionWriter writer( path );
+	if ( ! writer.isOpen() )
+	{
+		return false;
+	}
+
+	for ( const Pose &pose : poses )
+	{
+		writer.addPose( pose );
+	}
+	return writer.close( rate );
+}
+
+PoseDatabase::SessionWriter::SessionWriter( const fs::path &path ) :
+	mStream( path.string().c_str(), std::ios::binary )
+{
+	// the frame count and the rate are known when the session is closed
+	uint8_t header[ SESSION_HEADER_SIZE ];
+	std::memcpy( header, SESSION_MAGIC, 4 );
+	writeUint32( header + 4, SESSION_VERSION );
+	writeUint32( header + 8, static_cast< uint32_t >( N ) );
+	writeUint32( header + 12, 0 );
+	writeFloat( header + 16, 0.0f );
+	mStream.write( reinterpret_cast< const char * >( header ), sizeof( header ) );
+}
+
+void PoseDatabase::SessionWriter::addPose( const Pose &pose )
+{
+	uint8_t orientations[ N * 4 * sizeof( float ) ];
+	for ( size_t i = 0; i < N; i++ )
+	{
+		const Quatf &q = pose.mOrientations[ i ];
+		uint8_t *o = orientations + i * 4 * sizeof( float );
+		writeFloat( o, q.v.x );
+		writeFloat( o + 4, q.v.y );
+		writeFloat( o + 8, q.v.z );
+		writeFloat( o + 12, q.w );
+	}
+	mStream.write( reinterpret_cast< const char * >( orientations ), sizeof( orientations ) );
+	mNumFrames++;
+}
+
+bool PoseDatabase::SessionWriter::close( float rate )
+{
+	uint8_t counts[ 8 ];
+	writeUint32( counts, static_cast< uint32_t >( mNumFrames ) );
+	writeFloat( counts + 4, rate );
+	mStream.seekp( 12 );
+	mStream.write( reinterpret_cast< const char * >( counts ), sizeof( counts ) );
+	bool good = mStream.good();
+	mStream.close();
+	return good;
+}
+
+void PoseDatabase::buildIndex()
+{
+	mTreeFrames.resize( mNumFrames );
+	mTreeRadii.assign( mNumFrames, 0.0f );
+	for ( size_t f = 0; f < mNumFrames; f++ )
+	{
+		mTreeFrames[ f ] = static_cast< uint32_t >( f );
+	}
+
+	// one distance per tree slot, the nodes partition their own range of it
+	std::vector< float > distances( mNumFrames );
+	build( 0, mNumFrames, distances.data() );
+}
+
+void PoseDatabase::build( size_t begin, size_t end, float *distances )
+{
+	if ( end - begin <= 1 )
+	{
+		return;
+	}
+
+	// the middle frame of the range is the vantage point, neighbouring frames are similar
+	std::swap( mTreeFrames[ begin ], mTreeFrames[ ( begin + end ) / 2 ] );
+	const float *vantage = getFeature( mTreeFrames[ begin ] );
+	for ( size_t i = begin + 1; i < end; i++ )
+	{
+		distances[ i ] = distanceSq( vantage, getFeature( mTreeFrames[ i ] ) );
+	}
+
+	// quickselect of the inner half over ( begin, end ), the frames move with their distances
+	size_t inside = ( end - begin ) / 2;
+	size_t nth = begin + inside;
+	size_t lo = begin + 1;
+	size_t hi = end - 1;
+	while ( lo < hi )
+	{
+		float pivot = distances[ lo + ( hi - lo ) / 2 ];
+		size_t i = lo;
+		size_t j = hi;
+		while ( i <= j )
+		{
+			while ( distances[ i ] < pivot )
+			{
+				i++;
+			}
+			while ( distances[ j ] > pivot )
+			{
+				j--;
+			}
+			if ( i <= j )
+			{
+				std::swap( distances[ i ], distances[ j ] );
+				std::swap( mTreeFrames[ i ], mTreeFrames[ j ] );
+				i++;
+				j--;
+			}
+		}
+		if ( nth <= j )
+		{
+			hi = j;
+		}
+		else if ( nth >= i )
+		{
+			lo = i;
+		}
+		else
+		{
+			break;
+		}
+	}
+	mTreeRadii[ begin ] = std::sqrt( distances[ nth ] );
+
+	build( begin + 1, begin + 1 + inside, distances );
+	build( begin + 1 + inside, end, distances );
+}
+
+size_t PoseDatabase::findNearest( const Pose &pose ) const
+{
+	if ( mTreeFrames.size() != mNumFrames )
+	{
+		return findNearestLinear( pose );
+	}
+
+	alignas( 32 ) float query[ FEATURE_SIZE ];
+	poseToFeature( pose, query );
+
+	size_t best = npos;
+	float bestDistance = std::numeric_limits< float >::max();
+	size_t visits = 0;
+	search( 0, mNumFrames, query, &best, &bestDistance, &visits );
+	return best;
+}
+
+void PoseDatabase::search( size_t begin, size_t end, const float *query,
+						   size_t *best, float *bestDistance, size_t *visits ) const
+{
+	if ( begin >= end || ( mMaxVisits > 0 && *visits >= mMaxVisits ) )
+	{
+		return;
+	}
+
+	size_t frame = mTreeFrames[ begin ];
+	float d = std::sqrt( distanceSq( query, getFeature( frame ) ) );
+	( *visits )++;
+	if ( d < *bestDistance )
+	{
+		*bestDistance = d;
+		*best = frame;
+	}
+
+	size_t mid = begin + 1 + ( end - begin ) / 2;
+	float radius = mTreeRadii[ begin ];
+	// the side of the query first, the other side only if the best ball crosses the radius
+	if ( d < radius )
+	{
+		search( begin + 1, mid, query, best, bestDistance, visits );
+		if ( d + *bestDistance >= radius )
+		{
+			search( mid, end, query, best, bestDistance, visits );
+		}
+	}
+	else
+	{
+		search( mid, end, query, best, bestDistance, visits );
+		if ( d - *bestDistance <= radius )
+		{
+			search( begin + 1, mid, query, best, bestDistance, visits );
+		}
+	}
+}
+
+size_t PoseDatabase::findNearestLinear( const Pose &pose ) const
+{
+	alignas( 32 ) float query[ FEATURE_SIZE ];
+	poseToFeature( pose, query );
+
+	size_t best = npos;
+	float bestDistance = std::numeric_limits< float >::max();
+	for ( size_t f = 0; f < mNumFrames; f++ )
+	{
+		float d = distanceSq( query, getFeature( f ) );
+		if ( d < bestDistance )
+		{
+			bestDistance = d;
+			best = f;
+		}
+	}
+	return best;
+}
+
+size_t PoseDatabase::getNextFrame( size_t frame ) const
+{
+	if ( frame + 1 >= mNumFrames || mFrameSessions[ frame + 1 ] != mFrameSessions[ frame ] )
+	{
+		return npos;
+	}
+	return frame + 1;
+}
+
+float PoseDatabase::getRate( size_t frame ) const
+{
+	return mSessions[ mFrameSessions[ frame ] ].mRate;
+}
+
+void PoseDatabase::getPose( size_t frame, Pose *pose ) const
+{
+	const float *feature = getFeature( frame );
+	for ( size_t i = 0; i < N; i++ )
+	{
+		pose->mOrientations[ i ] = Quatf( feature[ 3 * N + i ], feature[ i ], feature[ N + i ], feature[ 2 * N + i ] );
+	}
+	pose->mOrientationMask.set();
+}
+
+void PoseDatabase::poseToFeature( const Pose &pose, float *feature )
+{
+	for ( size_t i = 0; i < N; i++ )
+	{
+		setFeatureJoint( i, pose.mOrientationMask[ i ] ? pose.mOrientations[ i ] : Quatf(), feature );
+	}
+	std::fill( feature + 4 * N, feature + FEATURE_SIZE, 0.0f );
+}
+
+void PoseDatabase::setFeatureJoint( size_t joint, const Quatf &q, float *feature )
+{
+	// q and -q are the same rotation, the features use the half with positive w
+	float s = q.w < 0.0f ? -1.0f : 1.0f;
+	feature[ joint ] = q.v.x * s;
+	feature[ N + joint ] = q.v.y * s;
+	feature[ 2 * N + joint ] = q.v.z * s;
+	feature[ 3 * N + joint ] = q.w * s;
+}
+
+float PoseDatabase::distanceSq( const float *a, const float *b )
+{
+	// eight partial sums, the loop vectorizes without reassociating the additions
+	float sums[ 8 ] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+	for ( size_t i = 0; i < FEATURE_SIZE; i += 8 )
+	{
+		for ( size_t j = 0; j < 8; j++ )
+		{
+			float d = a[ i + j ] - b[ i + j ];
+			sums[ j ] += d * d;
+		}
+	}
+	return ( ( sums[ 0 ] + sums[ 1 ] ) + ( sums[ 2 ] + sums[ 3 ] ) ) +
+		   ( ( sums[ 4 ] + sums[ 5 ] ) + ( sums[ 6 ] + sums[ 7 ] ) );
+}
@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <cmath>
+
+#include "cinder/CinderMath.h"
+
+#include "PoseFilter.h"
+
+using namespace ci;
+
+// poses further apart restart the filter
+static const float MAX_POSE_INTERVAL = 0.5f;
+static const float MIN_POSE_INTERVAL = 0.001f;
+
+//! Smoothing factor of an exponential filter with \a cutoff Hz at \a dt seconds sample interval.
+static inline float smoothingFactor( float dt, float cutoff )
+{
+	float tau = 1.0f / ( 2.0f * float( M_PI ) * cutoff );
+	return 1.0f / ( 1.0f + tau / dt );
+}
+
+PoseFilter::PoseFilter()
+{
+	reset();
+}
+
+void PoseFilter::setPositionParams( float minCutoff, float beta )
+{
+	mPositionMinCutoff = std::max( minCutoff, 0.001f );
+	mPositionBeta = std::max( beta, 0.0f );
+}
+
+void PoseFilter::setOrientationParams( float minCutoff, float beta )
+{
+	mOrientationMinCutoff = std::max( minCutoff, 0.001f );
+	mOrientationBeta = std::max( beta, 0.0f );
+}
+
+void PoseFilter::reset()
+{
+	mLastTime = -1.0;
+	std::fill( &mPosition[ 0 ][ 0 ], &mPosition[ 0 ][ 0 ] + 3 * N, 0.0f );
+	std::fill( &mOrientation[ 0 ][ 0 ], &mOrientation[ 0 ][ 0 ] + 4 * N, 0.0f );
+	std::fill( mPositionValid, mPositionValid + N, 0.0f );
+	std::fill( mOrientationValid, mOrientationValid + N, 0.0f );
+	std::fill( mPositionSpeed, mPositionSpeed + N, 0.0f );
+	std::fill( mOrientationSpeed, mOrientationSpeed + N, 0.0f );
+}
+
+void PoseFilter::filter( Pose *pose, double time )
+{
+	float dt = static_cast< float >( time - mLastTime );
+	if ( mLastTime < 0.0 || dt > MAX_POSE_INTERVAL )
+	{
+		reset();
+	}
+	mLastTime = time;
+	dt = std::max( dt, MIN_POSE_INTERVAL );
+
+	for ( size_t i = 0; i < N; i++ )
+	{
+		const Vec3f &p = pose->mPositions[ i ];
+		mInPosition[ 0 ][ i ] = p.x;
+		mInPosition[ 1 ][ i ] = p.y;
+		mInPosition[ 2 ][ i ] = p.z;
+		mInPositionMask[ i ] = pose->mPositionMask[ i ] ? 1.0f : 0.0f;
+
+		const Quatf &q = pose->mOrientations[ i ];
+		mInOrientation[ 0 ][ i ] = q.w;
+		mInOrientation[ 1 ][ i ] = q.v.x;
+		mInOrientation[ 2 ][ i ] = q.v.y;
+		mInOrientation[ 3 ][ i ] = q.v.z;
+		mInOrientationMask[ i ] = pose->mOrientationMask[ i ] ? 1.0f : 0.0f;
+	}
+
+	filterPositions( dt );
+	filterOrientations( dt );
+
+	for ( size_t i = 0; i < N; i++ )
+	{
+		if ( pose->mPositionMask[ i ] )
+		{
+			pose->mPositions[ i ] = Vec3f( mPosition[ 0 ][ i ], mPosition[ 1 ][ i ], mPosition[ 2 ][ i ] );
+		}
+		if ( pose->mOrientationMask[ i ] )
+		{
+			pose->mOrientations[ i ] = Quatf( mOrientation[ 0 ][ i ], mOrientation[ 1 ][ i ],
+											  mOrientation[ 2 ][ i ], mOrientation[ 3 ][ i ] );
+		}
+	}
+}
+
+void PoseFilter::filterPositions( float dt )
+{
+	const float derivativeAlpha = smoothingFactor( dt, mDerivativeCutoff );
+	const float tauScale = 1.0f / ( 2.0f * float( M_PI ) * dt );
+
+	float *__restrict px = mPosition[ 0 ];
+	float *__restrict py = mPosition[ 1 ];
+	float *__restrict pz = mPosition[ 2 ];
+	const float *__restrict ix = mInPosition[ 0 ];
+	const float *__restrict iy = mInPosition[ 1 ];
+	const float *__restrict iz = mInPosition[ 2 ];
+
+	// branchless, joints missing from the pose keep their state through the masks
+	for ( size_t i = 0; i < N; i++ )
+	{
+		float mask = mInPositionMask[ i ];
+		float valid = mPositionValid[ i ];
+
+		float dx = ix[ i ] - px[ i ];
+		float dy = iy[ i ] - py[ i ];
+		float dz = iz[ i ] - pz[ i ];
+		float speed = std::sqrt( dx * dx + dy * dy + dz * dz ) / dt * valid;
+		float speedHat = mPositionSpeed[ i ] + derivativeAlpha * ( speed - mPositionSpeed[ i ] );
+
+		float cutoff = mPositionMinCutoff + mPositionBeta * speedHat;
+		float alpha = 1.0f / ( 1.0f + tauScale / cutoff );
+		// the first sample of a joint passes unfiltered
+		alpha = ( alpha * valid + ( 1.0f - valid ) ) * mask;
+
+		px[ i ] += alpha * dx;
+		py[ i ] += alpha * dy;
+		pz[ i ] += alpha * dz;
+		mPositionSpeed[ i ] += mask * ( speedHat - mPositionSpeed[ i ] );
+		mPositionValid[ i ] = std::max( valid, mask );
+	}
+}
+
+void PoseFilter::filterOrientations( float dt )
+{
+	const float derivativeAlpha = smoothingFactor( dt, mDerivativeCutoff );
+	const float tauScale = 1.0f / ( 2.0f * float( M_PI ) * dt );
+
+	float *__restrict qw = mOrientation[ 0 ];
+	float *__restrict qx = mOrientation[ 1 ];
+	float *__restrict qy = mOrientation[ 2 ];
+	float *__restrict qz = mOrientation[ 3 ];
+	const float *__restrict iw = mInOrientation[ 0 ];
+	const float *__restrict ix = mInOrientation[ 1 ];
+	const float *__restrict iy = mInOrientation[ 2 ];
+	const float *__restrict iz = mInOrientation[ 3 ];
+
+	// normalized lerp instead of slerp, the steps between filtered poses are small
+	for ( size_t i = 0; i < N; i++ )
+	{
+		float mask = mInOrientationMask[ i ];
+		float valid = mOrientationValid[ i ];
+
+		float d = qw[ i ] * iw[ i ] + qx[ i ] * ix[ i ] + qy[ i ] * iy[ i ] + qz[ i ] * iz[ i ];
+		// take the shorter path
+		float s = std::copysign( 1.0f, d );
+		float absDot = std::min( d * s, 1.0f );
+		// 1 - cos( angle / 2 ) is about angle^2 / 8 for small angles
+		float angle = std::sqrt( 8.0f * ( 1.0f - absDot ) );
+		float speed = angle / dt * valid;
+		float speedHat = mOrientationSpeed[ i ] + derivativeAlpha * ( speed - mOrientationSpeed[ i ] );
+
+		float cutoff = mOrientationMinCutoff + mOrientationBeta * speedHat;
+		float alpha = 1.0f / ( 1.0f + tauScale / cutoff );
+		alpha = ( alpha * valid + ( 1.0f - valid ) ) * mask;
+
+		float w = qw[ i ] + alpha * ( s * iw[ i ] - qw[ i ] );
+		float x = qx[ i ] + alpha * ( s * ix[ i ] - qx[ i ] );
+		float y = qy[ i ] + alpha * ( s * iy[ i ] - qy[ i ] );
+		float z = qz[ i ] + alpha * ( s * iz[ i ] - qz[ i ] );
+		// invalid joints stay zero, the sum is never zero for masked ones
+		float lengthSq = w * w + x * x + y * y + z * z;
+		float invLength = 1.0f / std::sqrt( std::max( lengthSq, 1e-20f ) );
+
+		qw[ i ] = w * invLength;
+		qx[ i ] = x * invLength;
+		qy[ i ] = y * invLength;
+		qz[ i ] = z * invLength;
+		mOrientationSpeed[ i ] += mask * ( speedHat - mOrientationSpeed[ i ] );
+		mOrientationValid[ i ] = std::max( valid, mask );
+	}
+}
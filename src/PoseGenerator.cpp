@@ -0,0 +1,54 @@
+#include "cinder/CinderMath.h"
+#include "cinder/Rand.h"
+
+#include "PoseGenerator.h"
+
+using namespace ci;
+
+PoseGenerator::PoseGenerator( uint32_t seed ) :
+	mSeed( seed )
+{
+	Rand rnd( seed );
+	for ( size_t i = 0; i < Avatar::TOTAL_JOINTS; i++ )
+	{
+		// the hip and the spine move less than the limbs
+		float scale = ( i <= Avatar::CHEST ) ? 10.0f : 35.0f;
+		mAmplitudes[ i ] = Vec3f( rnd.nextFloat( scale ), rnd.nextFloat( scale ), rnd.nextFloat( scale ) );
+		mFrequencies[ i ] = Vec3f( rnd.nextFloat( 0.1f, 1.5f ), rnd.nextFloat( 0.1f, 1.5f ),
+								   rnd.nextFloat( 0.1f, 1.5f ) );
+		mPhases[ i ] = Vec3f( rnd.nextFloat( 2.0f * M_PI ), rnd.nextFloat( 2.0f * M_PI ),
+							  rnd.nextFloat( 2.0f * M_PI ) );
+	}
+}
+
+void PoseGenerator::generate( int32_t frameId )
+{
+	mFrameId = frameId;
+
+	float t = frameId / mRate;
+	// noise only depends on the seed and the frame id
+	Rand rnd( mSeed ^ ( static_cast< uint32_t >( frameId ) * 2654435761u ) );
+	for ( size_t i = 0; i < Avatar::TOTAL_JOINTS; i++ )
+	{
+		const Vec3f &a = mAmplitudes[ i ];
+		const Vec3f &f = mFrequencies[ i ];
+		const Vec3f &p = mPhases[ i ];
+		mEulerDegrees[ i ] = Vec3f( a.x * math< float >::sin( 2.0f * M_PI * f.x * t + p.x ),
+									a.y * math< float >::sin( 2.0f * M_PI * f.y * t + p.y ),
+									a.z * math< float >::sin( 2.0f * M_PI * f.z * t + p.z ) );
+		mEulerDegrees[ i ] += Vec3f( rnd.nextFloat( -mNoise, mNoise ), rnd.nextFloat( -mNoise, mNoise ),
+									 rnd.nextFloat( -mNoise, mNoise ) );
+	}
+
+	mRootPosition = Vec3f( 20.0f * math< float >::sin( 0.2f * M_PI * t ),
+						   5.0f * math< float >::sin( 2.0f * M_PI * t ), 0.0f );
+}
+
+void PoseGenerator::apply( const AvatarRef &avatar ) const
+{
+	avatar->setPosition( mFrameId, Avatar::HIP, mRootPosition );
+	for ( size_t i = 0; i < Avatar::TOTAL_JOINTS; i++ )
+	{
+		avatar->setOrientation( mFrameId, i, mEulerDegrees[ i ] );
+	}
+}
@@ -0,0 +1,81 @@
+#include <cctype>
+
+#include "cinder/Utilities.h"
+#include "cinder/Xml.h"
+#include "cinder/app/App.h"
+
+#include "Avatar.h"
+#include "RetargetMap.h"
+
+using namespace ci;
+
+static Quatf readQuat( const XmlTree &xml, const std::string &name )
+{
+	if ( ! xml.hasChild( name ) )
+	{
+		return Quatf();
+	}
+
+	const XmlTree &node = xml.getChild( name );
+	Quatf q( node.getAttributeValue( "w", 1.0f ),
+			 node.getAttributeValue( "x", 0.0f ),
+			 node.getAttributeValue( "y", 0.0f ),
+			 node.getAttributeValue( "z", 0.0f ) );
+	return q.normalized();
+}
+
+RetargetMapRef RetargetMap::createDefault()
+{
+	RetargetMapRef map = create();
+	for ( size_t i = 0; i < Avatar::TOTAL_JOINTS; i++ )
+	{
+		Entry entry;
+		entry.mSourceId = i;
+		entry.mTargetName = Avatar::getJointName( i );
+		map->mEntries.push_back( entry );
+	}
+	return map;
+}
+
+RetargetMap::RetargetMap( const DataSourceRef &source )
+{
+	XmlTree doc( source );
+	if ( ! doc.hasChild( "retarget" ) )
+	{
+		app::console() << "Warning: retarget map without <retarget> root " << source->getFilePathHint() << std::endl;
+		return;
+	}
+
+	const XmlTree &root = doc.getChild( "retarget" );
+	bool bindOffsets = root.getAttributeValue< std::string >( "offsets", "identity" ) == "bind";
+	for ( auto it = root.begin( "joint" ); it != root.end(); ++it )
+	{
+		std::string sourceName = it->getAttributeValue< std::string >( "source", "" );
+		std::string targetName = it->getAttributeValue< std::string >( "target", "" );
+
+		size_t sourceId;
+		if ( ! sourceName.empty() && std::isdigit( static_cast< unsigned char >( sourceName[ 0 ] ) ) )
+		{
+			sourceId = fromString< size_t >( sourceName );
+		}
+		else
+		{
+			sourceId = Avatar::findJointId( sourceName );
+		}
+
+		if ( sourceId >= Avatar::TOTAL_JOINTS || targetName.empty() )
+		{
+			app::console() << "Warning: invalid retarget entry " << sourceName << " -> " << targetName << std::endl;
+			continue;
+		}
+
+		Entry entry;
+		entry.mSourceId = sourceId;
+		entry.mTargetName = targetName;
+		entry.mPreOffset = readQuat( *it, "pre" );
+		entry.mPostOffset = readQuat( *it, "post" );
+		entry.mPositionScale = it->getAttributeValue( "positionScale", 1.0f );
+		entry.mBindOffsets = bindOffsets && ! it->hasChild( "pre" ) && ! it->hasChild( "post" );
+		mEntries.push_back( entry );
+	}
+}
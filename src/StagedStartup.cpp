@@ -0,0 +1,102 @@
+#include <exception>
+
+#include "cinder/Timer.h"
+#include "cinder/app/App.h"
+
+#include "StagedStartup.h"
+
+using namespace ci;
+
+StagedStartup::~StagedStartup()
+{
+	mCancelled = true;
+	for ( auto &worker : mWorkers )
+	{
+		worker.join();
+	}
+}
+
+void StagedStartup::addStage( const std::string &name, const std::function< void () > &workerFn,
+							  const std::function< bool () > &mainFn )
+{
+	std::unique_ptr< Stage > stage( new Stage() );
+	stage->mName = name;
+	stage->mWorkerFn = workerFn;
+	stage->mMainFn = mainFn;
+	stage->mWorkerDone = ! workerFn;
+	mStages.push_back( std::move( stage ) );
+}
+
+void StagedStartup::start()
+{
+	for ( size_t i = 0; i < mNumWorkers; i++ )
+	{
+		mWorkers.push_back( std::thread( &StagedStartup::runWorker, this ) );
+	}
+}
+
+void StagedStartup::runWorker()
+{
+	while ( ! mCancelled )
+	{
+		size_t i = mNextWorkerStage++;
+		if ( i >= mStages.size() )
+		{
+			break;
+		}
+
+		Stage &stage = *mStages[ i ];
+		if ( stage.mWorkerFn )
+		{
+			try
+			{
+				stage.mWorkerFn();
+			}
+			catch ( const std::exception &exc )
+			{
+				app::console() << "Error: startup stage " << stage.mName << " failed: " << exc.what() << std::endl;
+			}
+		}
+		stage.mWorkerDone = true;
+	}
+}
+
+void StagedStartup::update( double budgetMs )
+{
+	Timer timer( true );
+	bool called = false;
+	for ( auto &s : mStages )
+	{
+		Stage &stage = *s;
+		if ( stage.mDone || ! stage.mWorkerDone )
+		{
+			continue;
+		}
+
+		while ( ! stage.mDone && ( ! called || timer.getSeconds() * 1000.0 < budgetMs ) )
+		{
+			stage.mDone = ! stage.mMainFn || stage.mMainFn();
+			called = true;
+		}
+		if ( stage.mDone )
+		{
+			mNumDone++;
+		}
+		if ( timer.getSeconds() * 1000.0 >= budgetMs )
+		{
+			break;
+		}
+	}
+}
+
+std::string StagedStartup::getStatus() const
+{
+	for ( const auto &stage : mStages )
+	{
+		if ( ! stage->mDone )
+		{
+			return stage->mName;
+		}
+	}
+	return "";
+}
@@ -0,0 +1,283 @@
+#include <cstring>
+
+#include "cinder/app/App.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+#include <libswscale/swscale.h>
+}
+
+#include "VideoRecorder.h"
+
+using namespace ci;
+
+VideoRecorder::VideoRecorder( const fs::path &path, int width, int height, const Format &format ) :
+	mWidth( width ), mHeight( height ), mFormat( format ),
+	mFreeFrames( format.mQueueSize ), mQueuedFrames( format.mQueueSize )
+{
+	if ( ! openEncoder( path ) )
+	{
+		closeEncoder();
+		return;
+	}
+
+	size_t frameSize = mWidth * mHeight * 4;
+	for ( size_t i = 0; i < mFreeFrames.getCapacity(); i++ )
+	{
+		mFrames.push_back( std::unique_ptr< Frame >( new Frame() ) );
+		mFrames.back()->mPixels.resize( frameSize );
+		mFreeFrames.push( mFrames.back().get() );
+	}
+
+	glGenBuffers( NUM_PBOS, mPbos );
+	for ( size_t i = 0; i < NUM_PBOS; i++ )
+	{
+		glBindBuffer( GL_PIXEL_PACK_BUFFER, mPbos[ i ] );
+		glBufferData( GL_PIXEL_PACK_BUFFER, frameSize, nullptr, GL_STREAM_READ );
+		mPboPts[ i ] = -1;
+	}
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+
+	mOpen = true;
+	mEncoderRunning = true;
+	mEncoderThread = std::thread( &VideoRecorder::encodeFrames, this );
+}
+
+VideoRecorder::~VideoRecorder()
+{
+	finish();
+	if ( mEncoderThread.joinable() )
+	{
+		mEncoderThread.join();
+	}
+}
+
+void VideoRecorder::finish()
+{
+	if ( ! mOpen || mFinishing )
+	{
+		return;
+	}
+	mFinishing = true;
+
+	// the frames still in flight in the pbos
+	for ( size_t i = 1; i <= NUM_PBOS; i++ )
+	{
+		queuePbo( ( mPboIndex + i ) % NUM_PBOS );
+	}
+	glDeleteBuffers( NUM_PBOS, mPbos );
+
+	// the encoder drains the queue and closes the file on its own thread
+	mEncoderRunning = false;
+	mEncoderCondition.notify_one();
+}
+
+void VideoRecorder::captureFrame( double time )
+{
+	if ( ! mOpen || mFinishing )
+	{
+		return;
+	}
+
+	// frames faster than the video frame rate are skipped before the readback
+	int64_t pts = static_cast< int64_t >( time * mFormat.mFps + 0.5 );
+	if ( pts <= mLastPts )
+	{
+		return;
+	}
+	mLastPts = pts;
+
+	// start the transfer of this frame, then map the oldest pbo which finished by now
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, mPbos[ mPboIndex ] );
+	glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+	glReadBuffer( GL_BACK );
+	glReadPixels( 0, 0, mWidth, mHeight, GL_BGRA, GL_UNSIGNED_BYTE, 0 );
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+	mPboPts[ mPboIndex ] = pts;
+	mCapturedFrames++;
+
+	mPboIndex = ( mPboIndex + 1 ) % NUM_PBOS;
+	queuePbo( mPboIndex );
+}
+
+void VideoRecorder::queuePbo( size_t pboIndex )
+{
+	if ( mPboPts[ pboIndex ] < 0 )
+	{
+		return;
+	}
+
+	// map before taking a frame, the encoder thread is the only one that returns frames to the free queue
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, mPbos[ pboIndex ] );
+	const void *pixels = glMapBuffer( GL_PIXEL_PACK_BUFFER, GL_READ_ONLY );
+	Frame *frame;
+	if ( pixels && mFreeFrames.pop( &frame ) )
+	{
+		std::memcpy( frame->mPixels.data(), pixels, frame->mPixels.size() );
+		frame->mPts = mPboPts[ pboIndex ];
+		mQueuedFrames.push( frame );
+		mEncoderCondition.notify_one();
+	}
+	else
+	{
+		// the encoder is behind or the mapping failed, never wait for it
+		mDroppedFrames++;
+	}
+	if ( pixels )
+	{
+		glUnmapBuffer( GL_PIXEL_PACK_BUFFER );
+	}
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+	mPboPts[ pboIndex ] = -1;
+}
+
+bool VideoRecorder::openEncoder( const fs::path &path )
+{
+	const std::string filename = path.string();
+	if ( avformat_alloc_output_context2( &mFormatContext, nullptr, nullptr, filename.c_str() ) < 0 )
+	{
+		app::console() << "Error: cannot create video output " << filename << std::endl;
+		return false;
+	}
+
+	const AVCodec *codec = avcodec_find_encoder_by_name( mFormat.mCodec.c_str() );
+	if ( ! codec )
+	{
+		app::console() << "Error: video encoder not found " << mFormat.mCodec << std::endl;
+		return false;
+	}
+
+	mStream = avformat_new_stream( mFormatContext, nullptr );
+	mCodecContext = avcodec_alloc_context3( codec );
+	if ( ! mStream || ! mCodecContext )
+	{
+		return false;
+	}
+
+	mCodecContext->width = mWidth & ~1;
+	mCodecContext->height = mHeight & ~1;
+	mCodecContext->time_base = AVRational { 1, mFormat.mFps };
+	mCodecContext->framerate = AVRational { mFormat.mFps, 1 };
+	mCodecContext->pix_fmt = AV_PIX_FMT_YUV420P;
+	mCodecContext->gop_size = mFormat.mFps * 2;
+	if ( mFormatContext->oformat->flags & AVFMT_GLOBALHEADER )
+	{
+		mCodecContext->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+	}
+	av_opt_set( mCodecContext->priv_data, "preset", mFormat.mPreset.c_str(), 0 );
+	av_opt_set_int( mCodecContext->priv_data, "crf", mFormat.mCrf, 0 );
+
+	if ( avcodec_open2( mCodecContext, codec, nullptr ) < 0 )
+	{
+		app::console() << "Error: cannot open video encoder " << mFormat.mCodec << std::endl;
+		return false;
+	}
+	avcodec_parameters_from_context( mStream->codecpar, mCodecContext );
+	mStream->time_base = mCodecContext->time_base;
+
+	if ( ! ( mFormatContext->oformat->flags & AVFMT_NOFILE ) &&
+		 avio_open( &mFormatContext->pb, filename.c_str(), AVIO_FLAG_WRITE ) < 0 )
+	{
+		app::console() << "Error: cannot open video file " << filename << std::endl;
+		return false;
+	}
+	if ( avformat_write_header( mFormatContext, nullptr ) < 0 )
+	{
+		return false;
+	}
+
+	mAvFrame = av_frame_alloc();
+	mAvFrame->format = mCodecContext->pix_fmt;
+	mAvFrame->width = mCodecContext->width;
+	mAvFrame->height = mCodecContext->height;
+	av_frame_get_buffer( mAvFrame, 0 );
+	mPacket = av_packet_alloc();
+
+	mSwsContext = sws_getContext( mWidth, mHeight, AV_PIX_FMT_BGRA,
+								  mCodecContext->width, mCodecContext->height, AV_PIX_FMT_YUV420P,
+								  SWS_FAST_BILINEAR, nullptr, nullptr, nullptr );
+	return mSwsContext != nullptr;
+}
+
+void VideoRecorder::closeEncoder()
+{
+	if ( mCodecContext && mOpen )
+	{
+		// flush the delayed frames
+		avcodec_send_frame( mCodecContext, nullptr );
+		writePackets();
+		av_write_trailer( mFormatContext );
+	}
+
+	if ( mFormatContext && mFormatContext->pb && ! ( mFormatContext->oformat->flags & AVFMT_NOFILE ) )
+	{
+		avio_closep( &mFormatContext->pb );
+	}
+	sws_freeContext( mSwsContext );
+	av_packet_free( &mPacket );
+	av_frame_free( &mAvFrame );
+	avcodec_free_context( &mCodecContext );
+	avformat_free_context( mFormatContext );
+	mFormatContext = nullptr;
+	mSwsContext = nullptr;
+}
+
+void VideoRecorder::encodeFrames()
+{
+	while ( true )
+	{
+		Frame *frame;
+		if ( mQueuedFrames.pop( &frame ) )
+		{
+			encodeFrame( frame );
+			mFreeFrames.push( frame );
+			continue;
+		}
+
+		if ( ! mEncoderRunning )
+		{
+			closeEncoder();
+			mFinished = true;
+			break;
+		}
+
+		// the producer notifies without locking, the timeout covers a missed wakeup
+		std::unique_lock< std::mutex > lock( mEncoderMutex );
+		mEncoderCondition.wait_for( lock, std::chrono::milliseconds( 5 ) );
+	}
+}
+
+void VideoRecorder::encodeFrame( const Frame *frame )
+{
+	if ( av_frame_make_writable( mAvFrame ) < 0 )
+	{
+		mDroppedFrames++;
+		return;
+	}
+
+	// opengl rows are bottom up, start from the last row with a negative stride
+	int stride = -mWidth * 4;
+	const uint8_t *src[ 1 ] = { frame->mPixels.data() + ( mHeight - 1 ) * mWidth * 4 };
+	sws_scale( mSwsContext, src, &stride, 0, mHeight, mAvFrame->data, mAvFrame->linesize );
+
+	mAvFrame->pts = frame->mPts;
+	if ( avcodec_send_frame( mCodecContext, mAvFrame ) < 0 )
+	{
+		mDroppedFrames++;
+		return;
+	}
+	writePackets();
+	mEncodedFrames++;
+}
+
+void VideoRecorder::writePackets()
+{
+	while ( avcodec_receive_packet( mCodecContext, mPacket ) == 0 )
+	{
+		av_packet_rescale_ts( mPacket, mCodecContext->time_base, mStream->time_base );
+		mPacket->stream_index = mStream->index;
+		av_interleaved_write_frame( mFormatContext, mPacket );
+	}
+}